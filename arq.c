@@ -0,0 +1,596 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include "emulator.h"
+#include "gbn.h"
+#include "fec.h"
+#include "arq.h"
+
+/* ******************************************************************
+   What the GBN and SR protocols share.  Messages from layer 5 go through
+   the send queue, and packing, to the protocol's window, packets from
+   layer 3 through the FEC layer to the protocol's receiver and sender,
+   and each entity's one timer is kept set for whichever deadline of the
+   protocol, the queue or the FEC layer falls due first.
+
+   With BIDIRECTIONAL set both A and B send data, so every entity has a
+   sender half and a receiver half.  The state of each is kept per entity,
+   indexed by A or B.  ACKs for received data ride on outgoing data packets
+   where possible, and are only sent on their own when no data is going out.
+**********************************************************************/
+
+#define SENDQUEUE 0     /* 1 = queue messages that arrive while the window is full, 0 = drop them */
+#define QUEUEHIGH 50    /* high watermark: a queue this full refuses messages ... */
+#define QUEUELOW 25     /* ... until it has drained down to this low watermark */
+#define NAKINTERVAL RTT /* the shortest time between two NAKs for the same sequence number */
+#define PACKING 0       /* 1 = pack as many waiting messages as fit into each packet */
+#define PACKMAX (MTU / 20) /* with packing, the most messages in one packet */
+#define PACKDELAY 1.0   /* with packing, the longest a part-full packet waits for more messages */
+#define TIMERSLACK 0.0  /* how late the timer may go off, so that one already set can be kept */
+#define PATHSCHED 0     /* with several paths: 0 = weighted round robin, 1 = lowest RTT first */
+#define PATHWEIGHT(p) 1 /* weighted round robin: packets sent on path p in each round */
+
+/* generic procedure to compute the checksum of a packet.  Used by both sender and receiver
+   the simulator will overwrite part of your packet with 'z's.  It will not overwrite your
+   original checksum, unless it is flipping random bits (CORRUPTMODEL in the emulator).
+   This procedure must generate a different checksum to the original if the packet is corrupted.
+*/
+int ComputeChecksum(struct pkt packet)
+{
+  unsigned int checksum = 0;  /* unsigned, as bit errors can leave any value to add up */
+  int i;
+
+  checksum = packet.seqnum;
+  checksum += packet.acknum;
+  checksum += packet.nmsgs;
+  checksum += packet.flow;
+  checksum += packet.fec;
+  for ( i=0; i<MTU; i++ )
+    checksum += (int)(packet.payload[i]);
+
+  return (int)checksum;
+}
+
+bool IsCorrupted(struct pkt packet)
+{
+  if (packet.checksum == ComputeChecksum(packet))
+    return (false);
+  else
+    return (true);
+}
+
+const char entityname[2] = {'A', 'B'};  /* for tracing */
+
+/********* Send queue ************/
+
+struct sendqueue {
+  struct msg queue[QUEUEHIGH];    /* messages waiting for room in the window */
+  float queuetime[QUEUEHIGH];     /* time each queued message arrived */
+  int queuefirst, queuecount;     /* array index of the oldest queued message, and how many */
+  bool queueblocked;              /* true from reaching QUEUEHIGH until drained to QUEUELOW */
+};
+
+static struct sendqueue sendq[NFLOWS][2];
+
+/* Each entity has a single emulator timer.  It is shared by the sender's
+   retransmission timeout and packing delay, the receiver's held back
+   ACKs and the FEC layer's part-full block, and is always set for
+   whichever of them falls due first. */
+float rtodeadline[NFLOWS][2]; /* when the sender times out, NOTINUSE if not timing */
+float ackdeadline[NFLOWS][2]; /* when held back ACKs must be sent, NOTINUSE if none */
+static float packdeadline[NFLOWS][2]; /* when a part-full packet must be sent, NOTINUSE if none waits */
+static float timerdeadline[2];  /* when the emulator timer goes off, NOTINUSE if stopped */
+static float flowdue[2];        /* the earliest deadline of any flow, NOTINUSE if none */
+static int dueflow[2];          /* the flow it is for */
+
+/* the earlier of two deadlines, either of which may be NOTINUSE */
+static float earliest(float deadline, float other)
+{
+  if (deadline == NOTINUSE || (other != NOTINUSE && other < deadline))
+    return other;
+  return deadline;
+}
+
+/* the earliest of a flow's deadlines */
+static float flowdeadline(int AorB, int flow)
+{
+  float next = earliest(rtodeadline[flow][AorB], ackdeadline[flow][AorB]);
+
+  return earliest(next, packdeadline[flow][AorB]);
+}
+
+/* the deadlines of a flow may have changed.  The earliest deadline of any
+   flow is kept, so the flows only have to be looked through again when
+   the one it is for has moved it later or has none left */
+static void flowchanged(int AorB, int flow)
+{
+  float due = flowdeadline(AorB, flow);
+  int f;
+
+  if (flow != dueflow[AorB]) {
+    if (earliest(flowdue[AorB], due) != flowdue[AorB]) {
+      flowdue[AorB] = due;
+      dueflow[AorB] = flow;
+    }
+    return;
+  }
+  if (earliest(flowdue[AorB], due) == due) {
+    flowdue[AorB] = due;
+    return;
+  }
+
+  flowdue[AorB] = NOTINUSE;
+  for (f = 0; f < NFLOWS; f++) {
+    due = flowdeadline(AorB, f);
+    if (earliest(flowdue[AorB], due) != flowdue[AorB]) {
+      flowdue[AorB] = due;
+      dueflow[AorB] = f;
+    }
+  }
+}
+
+/* restart the entity's timer if the earliest deadline has changed.  Every
+   flow whose deadlines may have changed has been passed to flowchanged() */
+static void settimer(int AorB)
+{
+  float next = earliest(flowdue[AorB], fec_deadline(AorB));
+
+  if (next == timerdeadline[AorB])
+    return;
+
+  if (timerdeadline[AorB] != NOTINUSE)
+    stoptimer(AorB);
+  timerdeadline[AorB] = next;
+  if (next != NOTINUSE)
+    starttimer_slack(AorB, next - gettime(), TIMERSLACK);
+}
+
+/********* Path scheduler ************/
+
+/* With NPATHS above 1 each packet goes on the path chosen here.  The paths
+   are shared by the entity's flows.  Lowest RTT first sends on the path
+   with the shortest smoothed RTT.  A path is taken to have the RTT the
+   timeout is set for until it is measured, and a timeout on it at least
+   doubles its RTT, as a timeout backs off.  Weighted round robin sends
+   PATHWEIGHT(p) packets on path p in each round, spread out through the
+   round rather than back to back */
+static float pathrtt[2][NPATHS];   /* smoothed RTT of each path */
+static int pathcredit[2][NPATHS];  /* weighted round robin: each path's running credit */
+
+/* the path for the next packet A or B sends */
+int choosepath(int AorB)
+{
+  int p, best = 0, total = 0;
+
+  if (NPATHS == 1)
+    return 0;
+  if (PATHSCHED == 1) {
+    for (p = 1; p < NPATHS; p++)
+      if (pathrtt[AorB][p] < pathrtt[AorB][best])
+        best = p;
+    return best;
+  }
+  for (p = 0; p < NPATHS; p++) {
+    pathcredit[AorB][p] += PATHWEIGHT(p);
+    total += PATHWEIGHT(p);
+    if (pathcredit[AorB][p] > pathcredit[AorB][best])
+      best = p;
+  }
+  pathcredit[AorB][best] -= total;
+  return best;
+}
+
+/* fold a round trip time measured on a path into its smoothed RTT */
+void pathsample(int AorB, int path, float rtt)
+{
+  pathrtt[AorB][path] = 0.875 * pathrtt[AorB][path] + 0.125 * rtt;
+}
+
+/* a packet sent on a path has timed out */
+void pathtimeout(int AorB, int path)
+{
+  if (pathrtt[AorB][path] < RTT)
+    pathrtt[AorB][path] = RTT;
+  pathrtt[AorB][path] *= 2;
+}
+
+/* NAK the missing packet seqnum, unless it was NAKed less than NAKINTERVAL
+   ago.  Returns true if the NAK was sent */
+bool sendNAK(int AorB, int flow, int path, float naktime[], int seqnum)
+{
+  struct pkt sendpkt;
+  int i;
+
+  if (naktime[seqnum] != NOTINUSE && gettime() - naktime[seqnum] < NAKINTERVAL)
+    return false;
+  naktime[seqnum] = gettime();
+
+  if (TRACE > 0)
+    printf("----%c: gap before packet %d, send NAK!\n", entityname[AorB], seqnum);
+  sendpkt.seqnum = NAKSEQ;
+  sendpkt.acknum = seqnum;
+  sendpkt.nmsgs = 0;
+  sendpkt.flow = flow;
+  sendpkt.fec = NOTINUSE;
+  sendpkt.path = path;
+  for (i = 0; i < MTU; i++)
+    sendpkt.payload[i] = '0';
+  sendpkt.checksum = ComputeChecksum(sendpkt);
+  fec_send(AorB, &sendpkt, 1, false);
+  NAKs_sent++;
+  return true;
+}
+
+/* add a message to the back of the send queue */
+static void push(int AorB, int flow, struct msg message)
+{
+  struct sendqueue *q = &sendq[flow][AorB];
+  int last = (q->queuefirst + q->queuecount) % QUEUEHIGH;
+
+  q->queue[last] = message;
+  q->queuetime[last] = gettime();
+  q->queuecount++;
+}
+
+/* hold a message at the sender until the window has room for it */
+static void enqueue(int AorB, int flow, struct msg message)
+{
+  struct sendqueue *q = &sendq[flow][AorB];
+
+  if (q->queueblocked) {
+    if (TRACE > 0)
+      printf("----%c: New message arrives, send queue is full\n", entityname[AorB]);
+    queue_full++;
+    flow_dropped[flow]++;
+    return;
+  }
+
+  messages_queued++;
+  total_queue_depth += q->queuecount;
+  push(AorB, flow, message);
+  if (q->queuecount > max_queue_depth)
+    max_queue_depth = q->queuecount;
+
+  if (q->queuecount == QUEUEHIGH) {
+    if (TRACE > 0)
+      printf("----%c: send queue reached its high watermark\n", entityname[AorB]);
+    q->queueblocked = true;
+    queue_blocked++;
+  }
+}
+
+/* send queued messages, oldest first, while the window has room.  With
+   PACKING each packet takes as many queued messages as fit in it, and a
+   part-full packet is held back while earlier packets are unACKed, to
+   gather more messages, for at most PACKDELAY after its oldest message
+   arrived (Nagle's algorithm).  flush sends a part-full packet anyway */
+static void drain(int AorB, int flow, bool flush)
+{
+  struct sendqueue *q = &sendq[flow][AorB];
+  struct msg messages[PACKMAX];
+  float deadline;
+  int n, i;
+
+  packdeadline[flow][AorB] = NOTINUSE;
+  while (q->queuecount > 0 && windowopen(AorB, flow)) {
+    n = PACKING ? PACKMAX : 1;
+    if (n > q->queuecount) {
+      n = q->queuecount;
+      deadline = q->queuetime[q->queuefirst] + PACKDELAY;
+      if (inflight(AorB, flow) > 0 && !flush && gettime() < deadline) {
+        packdeadline[flow][AorB] = deadline;
+        break;
+      }
+    }
+
+    for (i = 0; i < n; i++) {
+      total_queue_delay += gettime() - q->queuetime[q->queuefirst];
+      messages[i] = q->queue[q->queuefirst];
+      q->queuefirst = (q->queuefirst + 1) % QUEUEHIGH;
+      q->queuecount--;
+    }
+    if (PACKING) {
+      packets_packed++;
+      messages_packed += n;
+    }
+    sendmessage(AorB, flow, messages, n);
+  }
+
+  if (q->queueblocked && q->queuecount <= QUEUELOW) {
+    if (TRACE > 0)
+      printf("----%c: send queue drained to its low watermark\n", entityname[AorB]);
+    q->queueblocked = false;
+  }
+}
+
+/* called from layer 5 (application layer), passed the message to be sent to other side */
+static void output(int AorB, struct msg message)
+{
+  int flow = message.flow;
+
+  if (SENDQUEUE) {
+    /* the queue keeps messages in order behind any already waiting */
+    enqueue(AorB, flow, message);
+    drain(AorB, flow, false);
+  }
+  /* without a send queue, packing holds at most one packet's worth */
+  else if (PACKING && sendq[flow][AorB].queuecount < PACKMAX) {
+    push(AorB, flow, message);
+    drain(AorB, flow, false);
+  }
+  /* if not blocked waiting on ACK */
+  else if (!PACKING && windowopen(AorB, flow)) {
+    if (TRACE > 1)
+      printf("----%c: New message arrives, send window is not full, send new messge to layer3!\n", entityname[AorB]);
+    sendmessage(AorB, flow, &message, 1);
+  }
+  /* if blocked,  window is full */
+  else {
+    if (TRACE > 0)
+      printf("----%c: New message arrives, send window is full\n", entityname[AorB]);
+    window_full++;
+    flow_dropped[flow]++;
+  }
+  flowchanged(AorB, flow);
+  settimer(AorB);
+}
+
+/* an ACK has slid the window, send any messages waiting for the room */
+void windowslid(int AorB, int flow)
+{
+  drain(AorB, flow, false);
+}
+
+
+/********* Receiver procedures ************/
+
+/* pass the messages packed in a data packet up to layer 5, in order */
+void deliver(int AorB, int flow, struct pkt packet)
+{
+  int i;
+
+  /* the checksum is a sum, so two bit errors can cancel out in it */
+  for (i = 0; i < packet.nmsgs && i < PACKMAX; i++)
+    tolayer5(AorB, packet.payload + 20 * i);
+  flow_delivered[flow] += i;
+}
+
+
+/********* Entry points, called by the emulator ************/
+
+/* whether a packet's sequence and ACK numbers are ones the protocol sends.
+   The checksum is a sum, so two bit errors can cancel out in it and leave
+   any value in them, and one out of range would index past the window */
+bool numbersinrange(struct pkt packet)
+{
+  return (packet.seqnum == NOTINUSE || packet.seqnum == NAKSEQ
+          || (packet.seqnum >= 0 && packet.seqnum < seqspace))
+      && (packet.acknum == NOTINUSE || (packet.acknum >= 0 && packet.acknum < seqspace));
+}
+
+/* act on one packet that has arrived at the entity */
+static void entityinput(int AorB, struct pkt packet)
+{
+  /* a flow number out of range can only come from a damaged header */
+  if (packet.flow < 0 || packet.flow >= NFLOWS)
+    return;
+  packetinput(AorB, receiverof(AorB, packet.flow), packet);
+  flowchanged(AorB, packet.flow);
+}
+
+/* called from layer 3, when a packet arrives for layer 4 */
+static void input(int AorB, struct pkt packet)
+{
+  struct pkt packets[FECMAXK + 1];
+  int n, i;
+
+  /* the FEC layer may hold back parity, or add packets it has rebuilt */
+  n = fec_receive(AorB, packet, packets);
+  for (i = 0; i < n; i++)
+    entityinput(AorB, packets[i]);
+  settimer(AorB);
+}
+
+/* whether a packet is an uncorrupted pure ACK, and the next in a batch one
+   for the same flow */
+static bool foldable(struct pkt packet, struct pkt next)
+{
+  return packet.seqnum == NOTINUSE && packet.acknum != NOTINUSE && packet.fec < 0
+      && packet.flow >= 0 && packet.flow < NFLOWS && !IsCorrupted(packet)
+      && next.seqnum == NOTINUSE && next.acknum != NOTINUSE && next.fec < 0
+      && next.flow == packet.flow && !IsCorrupted(next)
+      && numbersinrange(packet) && numbersinrange(next);
+}
+
+/* called from layer 3 with packets that arrived together.  In a run of
+   pure ACKs for a flow the protocol acts on each but the last only as far
+   as it need be, so the window slides and the sender drains once for the
+   run, and the timer is set once for the batch */
+static void input_batch(int AorB, struct pkt batch[], int count)
+{
+  struct pkt packets[FECMAXK + 1];
+  int n, i, j;
+
+  for (j = 0; j < count; j++) {
+    if (j + 1 < count && foldable(batch[j], batch[j + 1])
+        && foldACK(AorB, batch[j], batch[j + 1])) {
+      flowchanged(AorB, batch[j].flow);
+      continue;
+    }
+    n = fec_receive(AorB, batch[j], packets);
+    for (i = 0; i < n; i++)
+      entityinput(AorB, packets[i]);
+  }
+  settimer(AorB);
+}
+
+/* called when an entity's timer goes off */
+static void timerinterrupt(int AorB)
+{
+  float fired = timerdeadline[AorB];
+  bool acted;
+  int flow;
+
+  timerdeadline[AorB] = NOTINUSE;   /* the emulator timer is no longer running */
+  /* a timer that went off late acts on every deadline that has passed */
+  if (gettime() > fired)
+    fired = gettime();
+  for (flow = 0; flow < NFLOWS; flow++) {
+    acted = false;
+    if (packdeadline[flow][AorB] != NOTINUSE && packdeadline[flow][AorB] <= fired) {
+      /* no more messages came to fill the packet, send what there is */
+      if (TRACE > 0)
+        printf("----%c: packing delay expired, send part-full packet!\n", entityname[AorB]);
+      drain(AorB, flow, true);
+      acted = true;
+    }
+    if (ackdeadline[flow][AorB] != NOTINUSE && ackdeadline[flow][AorB] <= fired) {
+      /* no data went out to carry the held back ACKs, so send them on their own */
+      if (TRACE > 0)
+        printf("----%c: delayed ACK timer expired, send ACK!\n", entityname[AorB]);
+      sendheldACK(AorB, flow);
+      acted = true;
+    }
+    if (rtodeadline[flow][AorB] != NOTINUSE && rtodeadline[flow][AorB] <= fired) {
+      timeout(AorB, flow);
+      acted = true;
+    }
+    if (acted)
+      flowchanged(AorB, flow);
+  }
+  if (fec_deadline(AorB) != NOTINUSE && fec_deadline(AorB) <= fired)
+    fec_flush(AorB);
+  settimer(AorB);
+}
+
+/* initialise one entity's sender and receiver halves, for every flow */
+static void initentity(int AorB)
+{
+  int flow, i;
+
+  for (flow = 0; flow < NFLOWS; flow++) {
+    /* initialise the window, buffer, sequence number and send queue */
+    initsender(AorB, flow);
+    sendq[flow][AorB].queuefirst = 0;
+    sendq[flow][AorB].queuecount = 0;
+    sendq[flow][AorB].queueblocked = false;
+
+    initreceiver(receiverof(AorB, flow));
+
+    rtodeadline[flow][AorB] = NOTINUSE;
+    ackdeadline[flow][AorB] = NOTINUSE;
+    packdeadline[flow][AorB] = NOTINUSE;
+  }
+  timerdeadline[AorB] = NOTINUSE;
+  flowdue[AorB] = NOTINUSE;
+  dueflow[AorB] = 0;
+  for (i = 0; i < NPATHS; i++) {
+    pathrtt[AorB][i] = RTT;
+    pathcredit[AorB][i] = 0;
+  }
+  fec_init(AorB, RTT);
+}
+
+/* called from layer 5 (application layer), passed the message to be sent to other side */
+void A_output(struct msg message)
+{
+  output(A, message);
+}
+
+/* called from layer 3, when a packet arrives for layer 4 at A */
+void A_input(struct pkt packet)
+{
+  input(A, packet);
+}
+
+/* called from layer 3, when several packets arrive for layer 4 at A at once */
+void A_input_batch(struct pkt packets[], int count)
+{
+  input_batch(A, packets, count);
+}
+
+/* whether A_output() would take a message for the flow now, rather than
+   drop it, for a front-end that holds messages back until it would */
+int A_accepts(int flow)
+{
+  if (SENDQUEUE)
+    return !sendq[flow][A].queueblocked;
+  if (PACKING)
+    return sendq[flow][A].queuecount < PACKMAX;
+  return windowopen(A, flow);
+}
+
+/* called when A's timer goes off */
+void A_timerinterrupt(void)
+{
+  timerinterrupt(A);
+}
+
+/* the following routine will be called once (only) before any other */
+/* entity A routines are called. You can use it to do any initialization */
+void A_init(void)
+{
+  initentity(A);
+}
+
+/* called from layer 3, when a packet arrives for layer 4 at B*/
+void B_input(struct pkt packet)
+{
+  input(B, packet);
+}
+
+/* called from layer 3, when several packets arrive for layer 4 at B at once */
+void B_input_batch(struct pkt packets[], int count)
+{
+  input_batch(B, packets, count);
+}
+
+/* the following routine will be called once (only) before any other */
+/* entity B routines are called. You can use it to do any initialization */
+void B_init(void)
+{
+  initentity(B);
+}
+
+/* only called with BIDIRECTIONAL set; with simplex transfer from A-to-B, there is no B_output() */
+void B_output(struct msg message)
+{
+  output(B, message);
+}
+
+/* called when B's timer goes off */
+void B_timerinterrupt(void)
+{
+  timerinterrupt(B);
+}
+
+/* A server terminating many senders keeps B's receiver state apart for
+   each of them, and has each packet acted on against the state of the
+   session it belongs to, in place of the receiver of the packet's flow.
+   B's timer is not used, so DELAYEDACK and BIDIRECTIONAL are off for a
+   server, and so is FEC, whose state is kept per entity */
+
+/* bytes of receiver state a session needs */
+int B_sessionsize(void)
+{
+  return receiversize;
+}
+
+/* set up a new session's receiver state */
+void B_sessioninit(void *state)
+{
+  if (DELAYEDACK || BIDIRECTIONAL || fec_on()) {
+    printf("a server keeps no timers or FEC state for its sessions: DELAYEDACK, BIDIRECTIONAL and FECMODE must be 0\n");
+    exit(EXIT_FAILURE);
+  }
+  initreceiver(state);
+}
+
+/* called from layer 3, when a packet arrives at B for the session whose
+   state is given */
+void B_sessioninput(void *state, struct pkt packet)
+{
+  if (packet.flow < 0 || packet.flow >= NFLOWS)
+    return;
+  packetinput(B, state, packet);
+}
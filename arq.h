@@ -0,0 +1,107 @@
+/* ******************************************************************
+   The parts of the Go-Back-N (gbn.c) and Selective Repeat (sr.c)
+   protocols that are the same for both, in arq.c: the send queue and
+   packing, the entity's timer and the deadlines it is set for, the path
+   scheduler, NAKs, the checksum, the FEC layer's place on the way in,
+   and the entry points in gbn.h.  Each protocol keeps its own send
+   window and receiver, and provides the hooks declared at the end, which
+   are where the two differ: how a packet is put in the window, how an
+   ACK slides it, what a timeout resends and how the receiver ACKs.
+
+   Build with one protocol:  gcc emulator.c channel.c wire.c stats.c arq.c gbn.c fec.c -lm
+**********************************************************************/
+
+#define RTT  16.0       /* round trip time.  MUST BE SET TO 16.0 when submitting assignment */
+#define NOTINUSE (-1)   /* used to fill header fields that are not being used */
+#define DELAYEDACK 0    /* 1 = B holds back ACKs for in-order packets, 0 = ACK every packet */
+#define ACKEVERY 2      /* with delayed ACKs, B ACKs once per this many in-order packets */
+#define ACKDELAY 2.0    /* with delayed ACKs, the longest time B holds back an ACK */
+#define NAKS 0          /* 1 = the receiver NAKs a missing packet as soon as it sees the gap */
+#define NAKSEQ (-2)     /* seqnum of a NAK packet, whose acknum is the missing sequence number */
+
+/* the seqnum of a packet tells data, pure ACKs and NAKs apart: a sequence
+   number for data, NOTINUSE for a pure ACK and NAKSEQ for a NAK */
+
+/* 'A' and 'B', indexed by AorB, for tracing */
+extern const char entityname[2];
+
+/* the protocol's deadlines for each flow (first index) of A or B (second
+   index), NOTINUSE if there is none: when the sender times out, and when
+   held back ACKs must be sent.  arq.c sets the timer for them once it
+   has had the protocol act on a packet, a message or the timer */
+extern float rtodeadline[NFLOWS][2];
+extern float ackdeadline[NFLOWS][2];
+
+/* the checksum of a packet (struct pkt), over its header and payload,
+   and whether it is wrong */
+extern int ComputeChecksum(struct pkt);
+extern bool IsCorrupted(struct pkt);
+
+/* whether a packet's (struct pkt) sequence and ACK numbers are ones the
+   protocol sends */
+extern bool numbersinrange(struct pkt);
+
+/* the path for the next packet A or B (int) sends */
+extern int choosepath(int);
+
+/* A or B (int) measured a round trip time (float) on a path (int) */
+extern void pathsample(int, int, float);
+
+/* a packet A or B (int) sent on a path (int) has timed out */
+extern void pathtimeout(int, int);
+
+/* A or B (int) NAKs, for a flow (int) and on a path (int), a missing
+   sequence number (int), unless the receiver's last NAK time for it,
+   from the array given (float[], one per sequence number), was less than
+   NAKINTERVAL ago.  Returns true if the NAK was sent */
+extern bool sendNAK(int, int, int, float[], int);
+
+/* an ACK has slid a flow's (int) send window at A or B (int): send any
+   messages waiting for the room it made */
+extern void windowslid(int, int);
+
+/* pass the messages packed in a data packet (struct pkt) of a flow (int)
+   up to layer 5 at A or B (int), in order */
+extern void deliver(int, int, struct pkt);
+
+/********* Provided by the protocol ************/
+
+/* a receiver half; the protocol defines what is in it */
+struct receiver;
+
+/* SEQSPACE, and the bytes of a struct receiver */
+extern const int seqspace;
+extern const int receiversize;
+
+/* the receiver half of a flow (int) of A or B (int) */
+extern struct receiver *receiverof(int, int);
+
+/* set up the window and sequence number of a flow's (int) sender half of
+   A or B (int), and a receiver half */
+extern void initsender(int, int);
+extern void initreceiver(struct receiver *);
+
+/* whether a flow's (int) send window at A or B (int) has room for another
+   packet, and how many packets are in it awaiting an ACK */
+extern bool windowopen(int, int);
+extern int inflight(int, int);
+
+/* put messages (struct msg[]), how many (int), in a packet for a flow
+   (int) of A or B (int), and send it; the window must have room for it */
+extern void sendmessage(int, int, struct msg[], int);
+
+/* a flow's (int) retransmission deadline at A or B (int) has passed */
+extern void timeout(int, int);
+
+/* a flow's (int) held back ACK deadline at A or B (int) has passed, no
+   data having gone out to carry the ACKs */
+extern void sendheldACK(int, int);
+
+/* A or B (int) was given two uncorrupted pure ACKs (struct pkt) for the
+   same flow, one after the other, in a batch.  Returns true if the first
+   has been acted on as far as it need be, for the second to follow */
+extern bool foldACK(int, struct pkt, struct pkt);
+
+/* act on a packet (struct pkt) that has arrived at A or B (int), against
+   the receiver half (struct receiver *) of its flow or session */
+extern void packetinput(int, struct receiver *, struct pkt);
@@ -0,0 +1,250 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include "emulator.h"
+#include "channel.h"
+
+struct profile {
+  float loss;                 /* chance of losing a packet, below 0 for the one entered */
+  float corrupt;              /* chance of corrupting a packet, below 0 for the one entered */
+  int delaymodel;             /* the distribution of the delays, DELAYCONSTANT ... */
+  float delay;                /* their average */
+  float jitter;               /* their spread */
+};
+
+static const struct profile profiles[2] = {
+  {-1.0, -1.0, DELAYUNIFORM, 5.5, 4.5},   /* A to B */
+  {-1.0, -1.0, DELAYUNIFORM, 5.5, 4.5},   /* B to A */
+};
+
+float lossprob;
+float corruptprob;
+int corruptdirection;
+
+static int bad[2];                /* Gilbert-Elliott: the channel out of A or B is in the bad state */
+static char *losstrace;           /* trace replay: the trace, 1 for a lost packet */
+static int losstracelen;          /* trace replay: its length */
+static int losstracepos[2];       /* trace replay: where the channel out of A or B is in it */
+
+/* load LOSSTRACE for trace replay, keeping only its 0s and 1s */
+static void readlosstrace(void)
+{
+  FILE *f;
+  int c, size = 1024;
+
+  f = fopen(LOSSTRACE, "r");
+  losstrace = malloc(size);
+  if (f == NULL || losstrace == NULL) {
+    printf("can not read the loss trace %s\n", LOSSTRACE);
+    exit(EXIT_FAILURE);
+  }
+  losstracelen = 0;
+  while ((c = fgetc(f)) != EOF) {
+    if (c != '0' && c != '1')
+      continue;
+    if (losstracelen == size) {
+      size *= 2;
+      losstrace = realloc(losstrace, size);
+      if (losstrace == NULL) {
+        printf("memory allocation for the loss trace failed.");
+        exit(EXIT_FAILURE);
+      }
+    }
+    losstrace[losstracelen++] = c == '1';
+  }
+  fclose(f);
+  if (losstracelen == 0) {
+    printf("the loss trace %s has no 0s or 1s in it\n", LOSSTRACE);
+    exit(EXIT_FAILURE);
+  }
+}
+
+/* start both directions in the good state, at the start of the trace */
+void channel_init(void)
+{
+  int i;
+
+  for (i = 0; i < 2; i++) {
+    bad[i] = 0;
+    losstracepos[i] = 0;
+  }
+  if (LOSSMODEL == 2 && losstrace == NULL)
+    readlosstrace();
+}
+
+/* bytes a packet takes on the link: its header and the messages it
+   carries.  Parity is coded over whole packets, so a parity packet is
+   taken to be as long as the longest a packet can be */
+int wiresize(struct pkt *packet)
+{
+  if (FECPARITY(packet->fec))
+    return HEADERBYTES + MTU;
+  return HEADERBYTES + 20 * packet->nmsgs;
+}
+
+/* whether the loss and corruption probabilities entered apply to packets
+   out of A or B */
+static int entered(int AorB)
+{
+  return !(AorB == B && corruptdirection == A) && !(AorB == A && corruptdirection == B);
+}
+
+/* the loss probability of the channel out of A or B, and whether it
+   applies to its packets */
+static float lossrate(int AorB)
+{
+  return PROFILES && profiles[AorB].loss >= 0.0 ? profiles[AorB].loss : lossprob;
+}
+
+int lossapplies(int AorB)
+{
+  return (PROFILES && profiles[AorB].loss >= 0.0) || entered(AorB);
+}
+
+/* the corruption probability, or bit error rate, out of A or B, 0 if it
+   does not apply */
+static float corruptrate(int AorB)
+{
+  if (PROFILES && profiles[AorB].corrupt >= 0.0)
+    return profiles[AorB].corrupt;
+  return entered(AorB) ? corruptprob : 0.0;
+}
+
+/* a normally distributed number, mean 0 and standard deviation 1 */
+static double normal(void)
+{
+  double u = jimsrand();
+
+  if (u <= 0.0)
+    u = 1e-12;
+  return sqrt(-2.0 * log(u)) * cos(2.0 * M_PI * jimsrand());
+}
+
+/* how long after the packet ahead of it a packet out of A or B arrives */
+double channeldelay(int AorB)
+{
+  const struct profile *pr = &profiles[AorB];
+  double d, u;
+
+  if (!PROFILES)
+    return 1 + 9*jimsrand();
+  switch (pr->delaymodel) {
+  case DELAYCONSTANT:
+    d = pr->delay;
+    break;
+  case DELAYNORMAL:
+    d = pr->delay + pr->jitter * normal();
+    break;
+  case DELAYPARETO:
+    /* a Pareto tail from xm averages xm * shape / (shape - 1) */
+    u = jimsrand();
+    if (u <= 0.0)
+      u = 1e-12;
+    d = pr->delay - pr->jitter + pr->jitter * (PARETOSHAPE - 1.0) / PARETOSHAPE * pow(u, -1.0 / PARETOSHAPE);
+    break;
+  case DELAYLOGNORMAL:
+    /* exp(sigma z - sigma^2 / 2) averages 1 */
+    d = pr->delay - pr->jitter + pr->jitter * exp(LOGNORMALSIGMA * normal() - LOGNORMALSIGMA * LOGNORMALSIGMA / 2.0);
+    break;
+  default:
+    d = pr->delay - pr->jitter + 2.0 * pr->jitter * jimsrand();
+    break;
+  }
+  return d > 0.0 ? d : 0.0;
+}
+
+/* decide, as LOSSMODEL has it, whether the channel out of A or B loses
+   the next packet */
+int channelloss(int AorB)
+{
+  double bursts, badshare;
+  int c;
+
+  if (LOSSMODEL == 1) {
+    /* the share of time spent in the bad state gives the average loss */
+    badshare = lossrate(AorB) / GEBADLOSS;
+    if (badshare > 1.0)
+      badshare = 1.0;
+    if (bad[AorB]) {
+      if (jimsrand() < 1.0 / GEBURST)
+        bad[AorB] = 0;
+    }
+    else {
+      bursts = badshare >= 1.0 ? 1.0 : badshare / (1.0 - badshare) / GEBURST;
+      if (jimsrand() < bursts)
+        bad[AorB] = 1;
+    }
+    return bad[AorB] && jimsrand() < GEBADLOSS;
+  }
+  if (LOSSMODEL == 2) {
+    c = losstrace[losstracepos[AorB]];
+    losstracepos[AorB] = (losstracepos[AorB] + 1) % losstracelen;
+    return c;
+  }
+  return jimsrand() < lossrate(AorB);
+}
+
+/* the byte at an offset into a packet as it goes over the wire: its first
+   three header fields, the payload it uses and its last three header fields */
+static unsigned char *wirebyte(struct pkt *packet, int offset, int paylen)
+{
+  int *head[3] = {&packet->seqnum, &packet->acknum, &packet->checksum};
+  int *tail[3] = {&packet->fec, &packet->nmsgs, &packet->flow};
+
+  if (offset < 3 * (int)sizeof(int))
+    return (unsigned char *)head[offset / sizeof(int)] + offset % sizeof(int);
+  offset -= 3 * sizeof(int);
+  if (offset < paylen)
+    return (unsigned char *)packet->payload + offset;
+  offset -= paylen;
+  return (unsigned char *)tail[offset / sizeof(int)] + offset % sizeof(int);
+}
+
+/* flip each bit of the packet as it goes over the wire with probability
+   ber.  Returns how many bits were flipped */
+static int flipbits(struct pkt *packet, double ber)
+{
+  int paylen = wiresize(packet) - HEADERBYTES;
+  int nbits = wiresize(packet) * 8;
+  int bit = -1;
+  int flipped = 0;
+  double u, gap;
+
+  if (ber <= 0.0)
+    return 0;
+  while (1) {
+    /* the gap to the next bit error is geometric, drawn by inverting its
+       distribution, so the cost is in the errors and not the bits */
+    u = jimsrand();
+    if (ber >= 1.0)
+      gap = 1.0;
+    else if (u <= 0.0)
+      return flipped;
+    else
+      gap = 1.0 + floor(log(u) / log(1.0 - ber));
+    if (gap >= nbits - bit)
+      return flipped;
+    bit += (int)gap;
+
+    *wirebyte(packet, bit / 8, paylen) ^= 1 << (bit % 8);
+    flipped++;
+  }
+}
+
+/* corrupt a packet as CORRUPTMODEL has it */
+int channelcorrupt(int AorB, struct pkt *packet)
+{
+  float x;
+
+  if (CORRUPTMODEL == 1)
+    return flipbits(packet, corruptrate(AorB));
+  if (jimsrand() >= corruptrate(AorB))
+    return 0;
+  if ( (x = jimsrand()) < .75)
+    packet->payload[0]='Z';   /* corrupt payload */
+  else if (x < .875)
+    packet->seqnum = 999999;
+  else
+    packet->acknum = 999999;
+  return 1;
+}
@@ -0,0 +1,74 @@
+/* ******************************************************************
+   The channel's impairments: which packets it loses, which it corrupts and
+   how long each takes to cross.  The emulator draws on them for every
+   packet it carries, and so can the backends that run the protocol over a
+   real transport, so that all of them misbehave in the same way.  Each
+   program linking this in supplies jimsrand(), its source of random
+   numbers, and sets lossprob, corruptprob and corruptdirection.
+**********************************************************************/
+
+/* the impairments.  LOSSMODEL 0 loses each packet independently with the
+   loss probability entered.  1 is the Gilbert-Elliott model: the channel
+   flips between a good state, where it loses nothing, and a bad state,
+   where it loses GEBADLOSS of packets and stays for GEBURST packets on
+   average.  How often it goes bad is set so that the average loss is the
+   loss probability entered.  2 replays LOSSTRACE, a file of 0s and 1s, one
+   per packet, 1 for lost, from the start again when it runs out; the loss
+   probability entered is not used.
+   CORRUPTMODEL 0 is the original corruption, of the first payload byte or
+   the sequence or ACK number.  1 flips each bit of the packet as it is on
+   the wire, header and payload, at random, with the corruption
+   probability entered taken as the bit error rate */
+#define LOSSMODEL 0           /* 0 = independent, 1 = Gilbert-Elliott bursts, 2 = replay LOSSTRACE */
+#define GEBADLOSS 1.0         /* Gilbert-Elliott: the loss rate in the bad state */
+#define GEBURST 4.0           /* Gilbert-Elliott: average packets the bad state lasts */
+#define LOSSTRACE "loss.trace" /* trace replay: the file to replay */
+#define CORRUPTMODEL 0        /* 0 = the original corruption, 1 = random bit errors */
+
+/* with PROFILES on, each direction of the channel has a profile of its
+   own, so the ACK path can be slower or lossier than the data path.  A
+   loss or corruption probability below 0 takes the one entered, limited
+   to the direction entered as before.  Each packet arrives a delay after
+   the one ahead of it on its path (the link model times packets itself),
+   drawn from the profile's distribution:
+     DELAYCONSTANT   always delay
+     DELAYUNIFORM    evenly from delay - jitter to delay + jitter
+     DELAYNORMAL     averaging delay, jitter the standard deviation
+     DELAYPARETO     delay - jitter plus a heavy Pareto tail averaging jitter
+     DELAYLOGNORMAL  delay - jitter plus a lognormal tail averaging jitter
+   no delay being less than 0.  The original channel is uniform from 1 to
+   10 both ways, delay 5.5 and jitter 4.5 */
+#define PROFILES 0            /* 1 = each direction as profiles[] has it, 0 = both as entered */
+#define DELAYCONSTANT 0
+#define DELAYUNIFORM 1
+#define DELAYNORMAL 2
+#define DELAYPARETO 3
+#define DELAYLOGNORMAL 4
+#define PARETOSHAPE 1.5       /* Pareto: the shape of the tail, the nearer 1 the heavier */
+#define LOGNORMALSIGMA 1.0    /* lognormal: the standard deviation of the log of the tail */
+
+extern float lossprob;        /* probability that a packet is dropped  */
+extern float corruptprob;     /* probability that one bit is packet is flipped */
+extern int corruptdirection;  /* A->B A<-B or bidirectional corruption/loss */
+
+/* a random number uniform on [0,1], from the program linking this in */
+extern double jimsrand(void);
+
+/* reset the channel, loading LOSSTRACE if the loss model replays it */
+extern void channel_init(void);
+
+/* bytes a packet (struct pkt *) takes on the wire */
+extern int wiresize(struct pkt *);
+
+/* whether the channel out of A or B (int) loses its next packet, and
+   whether the loss probability applies to that direction at all */
+extern int channelloss(int);
+extern int lossapplies(int);
+
+/* corrupt, or not, a packet (struct pkt *) out of A or B (int) in place.
+   Returns 0 if it was left intact, else the number of bits flipped with
+   CORRUPTMODEL 1, and 1 with the original corruption */
+extern int channelcorrupt(int, struct pkt *);
+
+/* how long after the packet ahead of it a packet out of A or B (int) arrives */
+extern double channeldelay(int);
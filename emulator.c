@@ -1,29 +1,28 @@
-/* ***** THIS FILE SHOULD NOT BE MODIFIED ****************************
-   THERE IS NOT REASON THAT ANY STUDENT SHOULD HAVE TO READ OR UNDERSTAND
-   THE CODE BELOW.  YOU SHOLD NOT TOUCH, OR REFERENCE (in your code) ANY
-   OF THE DATA STRUCTURES BELOW.  If you're interested in how I designed
-   the emulator, you're welcome to look at the code - but again, you should have
-   to, and you defeinitely should not have to modify
-   This file contains the code that emulates the network.  It does not
-   implement any of the Go-Back-N protocol.
-   ********************************************************************
-
-   ******************************************************************
-   ALTERNATING BIT AND GO-BACK-N NETWORK EMULATOR: VERSION 1.1  J.F.Kurose
-   The code below emulates the layer 3 and below network environment:
-   - emulates the tranmission and delivery (possibly with bit-level corruption
-   and packet loss) of packets across the layer 3/4 interface
-   - handles the starting/stopping of a timer, and generates timer
-   interrupts (resulting in calling students timer handler).
-   - generates message to be sent (passed from later 5 to 4)
-
-   Network properties:
-   - one way network delay averages five time units (longer if there
-   are other messages in the channel for GBN), but can be larger
-   - packets can be corrupted (either the header or the data portion)
-   or lost, according to user-defined probabilities
-   - packets will be delivered in the order in which they were sent
-   (although some can be lost).
+/* ******************************************************************
+   Network emulator for the Go-Back-N and Selective Repeat protocols.
+   Grown from J.F.Kurose's ALTERNATING BIT AND GO-BACK-N NETWORK EMULATOR:
+   VERSION 1.1.  It runs a discrete event simulation of layer 3 and below
+   between two entities, A and B, and drives whichever protocol it is
+   built with (gbn.c or sr.c, with arq.c and fec.c) through the entry
+   points in gbn.h:
+   - layer 5 messages for A (and for B with BIDIRECTIONAL), generated or
+   read from INFILE with FILEMODE, dealt in turn to NFLOWS flows
+   - the channel: the original one, each packet arriving 1 to 10 time units
+   after the one ahead of it, or with LINKMODEL a chain of bottleneck links
+   with router queues (drop-tail or RED), over one or NPATHS paths.  Loss
+   and corruption come from channel.c, with PROFILES different for each
+   direction, REORDERPROB and DUPPROB reorder and copy packets, and
+   SCENARIO changes the channel mid-run
+   - packets arriving at an entity within INPUTWAIT of the first of them,
+   handed over in one batch call
+   - one timer per entity, whose event is kept in the list when it is
+   stopped and reused when it is started again within its slack
+   - a check of every delivery against the messages generated (VERIFY),
+   and statistics: per flow and Jain's fairness index, bytes on the wire
+   in the compact format of wire.c, FEC, and the file's goodput and hash
+
+   Build with a protocol:  gcc emulator.c channel.c wire.c stats.c arq.c gbn.c fec.c -lm
+   For SR, include sr.h in place of gbn.h and build with sr.c.
 
    Modifications (6/6/2008 - CLP): 
    - removed bidirectional GBN code and other code not used by prac. 
@@ -36,7 +35,15 @@
    ********************************************************************* */
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "emulator.h"
+#include "channel.h"
+#include "wire.h"
 #include "gbn.h"
 
 struct event {
@@ -44,6 +51,10 @@ struct event {
   int evtype;             /* event type code */
   int eventity;           /* entity where event occurs */
   struct pkt *pktptr;     /* ptr to packet (if any) assoc w/ this event */
+  int sendno;             /* for packets, the order it was sent in from its side */
+  int heldback;           /* for packets, held back so later packets overtake it */
+  int duplicate;          /* for packets, an extra copy made by the channel */
+  int corrupted;          /* for packets, corrupted by the channel */
   struct event *prev;
   struct event *next;
 };
@@ -54,18 +65,199 @@ struct event *evlist = NULL;   /* the event list */
 #define  TIMER_INTERRUPT 0  
 #define  FROM_LAYER5     1
 #define  FROM_LAYER3     2
+#define  SCENARIO_PHASE  3   /* eventity is the phase's index in phases[] */
 
 #define  OFF             0
 #define  ON              1
 
-int TRACE = 3;
+/* the channel.  With LINKMODEL off it is the original one: each packet
+   arrives 1 to 10 time units after the one ahead of it, and is lost only at
+   random.  With LINKMODEL on, each direction is a bottleneck link fed by a
+   router queue.  A packet waits in the queue for the link, takes its size
+   in bytes over BANDWIDTH to send, then PROPDELAY to cross the link.  A
+   full queue drops it (drop-tail), and RED can drop it early as the queue
+   builds up, so losses come from congestion as well as from lossprob.
+   The path can also be a chain of such links, A to R1 to ... to Rk to B,
+   each with its own settings, as listed in hops[] below; B's packets cross
+   it the other way.  lossprob and corruptprob still apply end to end */
+#define LINKMODEL 0        /* 1 = bottleneck link with a router queue, 0 = the original channel */
+#define BANDWIDTH 10.0     /* bytes the link sends per time unit */
+#define PROPDELAY 3.0      /* time a packet takes to cross the link once sent */
+#define ROUTERQUEUE 16     /* the most packets the router holds, counting the one being sent */
+#define RED 0              /* 1 = the router drops early at random (RED), 0 = drop-tail only */
+#define REDMIN 4.0         /* RED: average queue length below which nothing is dropped early */
+#define REDMAX 12.0        /* RED: average queue length from which every packet is dropped */
+#define REDMAXP 0.1        /* RED: early drop probability as the average nears REDMAX */
+#define REDWEIGHT 0.02     /* RED: weight of each new sample in the average queue length */
+
+struct hop {
+  float bandwidth;           /* bytes the link sends per time unit */
+  float propdelay;           /* time a packet takes to cross the link once sent */
+  int queue;                 /* the most packets the router in front of it holds, up to ROUTERQUEUE */
+  float loss;                /* chance the link loses a packet it sends */
+};
+
+/* the links from A to B, in order.  For example, a fast first and last
+   hop around a slow, lossy one in the middle:
+     {40.0, 1.0, ROUTERQUEUE, 0.0},
+     {BANDWIDTH, PROPDELAY, ROUTERQUEUE, 0.01},
+     {40.0, 1.0, ROUTERQUEUE, 0.0}, */
+static const struct hop hops[] = {
+  {BANDWIDTH, PROPDELAY, ROUTERQUEUE, 0.0},
+};
+
+#define HOPS ((int)(sizeof hops / sizeof hops[0]))
+
+/* with NPATHS above 1, A and B are joined by several channels, each as
+   above, and the sender picks the path for every packet.  Each path adds
+   its own delay and loss to the channel's: a packet sent on it arrives no
+   sooner than delay after it was sent */
+struct path {
+  float delay;               /* the least time a packet takes on the path */
+  float loss;                /* chance the path loses a packet, besides the channel's losses */
+};
+
+/* the first NPATHS of these are used */
+static const struct path paths[] = {
+  {0.0, 0.0},
+  {8.0, 0.05},
+  {4.0, 0.0},
+  {12.0, 0.1},
+};
+
+/* with REORDERPROB a packet is held back, so that up to about REORDERDEPTH
+   of the packets sent after it overtake it, and with DUPPROB the channel
+   delivers a packet twice.  Either way the rest stay in order */
+#define REORDERPROB 0.0       /* chance a packet is held back and arrives out of order */
+#define REORDERDEPTH 3        /* the most packets, on average, that overtake a held back one */
+#define DUPPROB 0.0           /* chance a packet is delivered twice */
+
+/* packets that arrive at an entity one after another in the event list,
+   the last no more than INPUTWAIT after the first, are handed over
+   together, in one A_input_batch() or B_input_batch() call, so that the
+   protocol can act on a burst at once.  They are handed over when the last
+   arrives, as a network card that holds its interrupt back for more
+   packets would hand them over.  With INPUTWAIT 0 only packets arriving at
+   the same time are, which the original channel never has, as it spaces
+   arrivals 1 to 10 time units apart */
+#define INPUTBATCH 64         /* the most packets handed over in one call, 1 = one at a time */
+#define INPUTWAIT 0.0         /* how long a batch waits after its first packet for more */
+
+/* with SCENARIO on, the channel changes part way through the run as
+   SCENARIOFILE says, to see how the protocol recovers.  Each line of the
+   file is a phase: the time it starts, optionally written t=5000, then
+   one of
+     loss P      the loss probability becomes P (0.2 or 20%)
+     corrupt P   the corruption probability becomes P
+     lambda X    the average time between messages becomes X
+     outage D    the channel loses every packet, both ways, for D
+     recover     back to the values entered, and any outage ends
+   in time order.  Anything after a # is a comment.  The values a phase
+   sets are the ones entered, so a direction's profile overrides them */
+#define SCENARIO 0            /* 1 = change the channel mid-run as SCENARIOFILE says */
+#define SCENARIOFILE "scenario.txt" /* the phases, one per line */
+#define MAXPHASES 64          /* the most phases a scenario can have */
+
+#define PHASELOSS 0
+#define PHASECORRUPT 1
+#define PHASELAMBDA 2
+#define PHASEOUTAGE 3
+#define PHASERECOVER 4
+
+static const char *phasenames[] = {"loss", "corrupt", "lambda", "outage", "recover"};
+
+struct phase {
+  float start;                /* when it begins */
+  int kind;                   /* PHASELOSS ... */
+  float value;                /* the new probability or lambda, or how long the outage lasts */
+  int delivered;              /* messages delivered before it began */
+  int resent;                 /* packets resent before it began */
+  float firstdelivery;        /* when the first message after it began was delivered, -1 if none */
+};
+
+static struct phase phases[MAXPHASES];
+static int nphases;
+static int curphase;          /* the phase in force, -1 before the first */
+
+/* with FILEMODE on, the messages are not letters but INFILE, 20 bytes at a
+   time, and what B delivers is written to OUTFILE.  The file decides how
+   many messages there are, not the number entered, and a message is only
+   given to A when it can take it, so none is dropped for a full window.
+   At the end a running hash of what was delivered is checked against one
+   of the file, and the goodput reported in MB/s, a time unit being
+   TIMEUNIT seconds.  The file is one stream, so NFLOWS must be 1 and
+   BIDIRECTIONAL 0 */
+#define FILEMODE 0            /* 1 = send INFILE to OUTFILE, 0 = generated messages */
+#define INFILE "input.bin"    /* the file to send */
+#define OUTFILE "output.bin"  /* where B's deliveries are written */
+#define TIMEUNIT 0.001        /* seconds in a time unit, for the goodput */
+
+#define FNVBASIS 14695981039346656037ULL  /* 64-bit FNV-1a, for the file hashes */
+#define FNVPRIME 1099511628211ULL
+
+static const unsigned char *filedata; /* INFILE, mapped */
+static long filesize;                 /* its size in bytes */
+static FILE *outfile;                 /* OUTFILE */
+static long filewritten;              /* bytes delivered and written to it */
+static unsigned long long filehash;   /* hash of INFILE */
+static unsigned long long outhash;    /* running hash of what was delivered */
 
-/* statistics updated by GBN */
-int window_full;   /* count of the number of messages dropped due to full window */
-int total_ACKs_received;
-int packets_resent;       /* count of the number of packets resent  */
-int new_ACKs;           /* count of the number of acks correctly received */
-int packets_received;  /* count of the packets received by receiver */
+/* every generated message carries its number in its last ten bytes, after
+   ten of its letter, and the verifier checks each message delivered against
+   the one generated with that number.  It keeps a byte of state for every
+   message, so the checks are a few operations a message and it can stay on
+   for benchmarks.  A message that is not one that was sent, or that the
+   sender dropped, or that is delivered twice, or to the side that sent it,
+   or before an earlier one of its flow, fails the run, as does a message
+   the sender took that is never delivered.  File mode checks its hash
+   instead */
+#define VERIFY 1              /* 1 = check every message delivered, 0 = only count them */
+#define VERIFYSHOW 10         /* problems printed as they are found, the rest only counted */
+
+#define MSGNEW 0              /* not generated yet */
+#define MSGSENT 1             /* taken by the sender, not delivered yet */
+#define MSGDROPPED 2          /* dropped by the sender */
+#define MSGDELIVERED 3        /* delivered */
+#define MSGTOB 4              /* or'ed in if it was given to A, to be delivered at B */
+
+static unsigned char *msgstate;   /* each message's MSG..., NULL if not verifying */
+static int nextmsg[2][NFLOWS];    /* the next message A and B expect on each flow */
+static int verify_skipped;        /* number delivered after a later one of their flow */
+static int verify_duplicates;     /* number delivered again */
+static int verify_mismatches;     /* number not as sent, or not to be delivered where they were */
+static int verify_shown;          /* problems printed */
+
+/* to tell resends that were not needed, the last data packet to arrive
+   intact with each sequence number, per side and flow.  A data packet
+   that arrives again just the same had a copy get through already */
+#define ARRIVALSLOTS 64       /* sequence numbers remembered, at least the protocol's SEQSPACE */
+
+struct arrival {
+  int seqnum;                 /* the sequence number, -1 if none has arrived yet */
+  int nmsgs;                  /* and the messages the packet carried */
+  int sendno;                 /* which transmission of it got through */
+  char payload[MTU];
+  int reordered;              /* it arrived out of order: held back or overtaking */
+};
+
+static struct arrival arrivals[2][NFLOWS][ARRIVALSLOTS];  /* by sending side, flow, sequence number */
+
+struct link {
+  float departure[ROUTERQUEUE];  /* when each queued packet will have been sent, oldest first */
+  int first, count;              /* ring index of the oldest queued packet, and how many */
+  float avgqueue;                /* RED's moving average of the queue length */
+  int sincedrop;                 /* RED: packets let in since the last early drop */
+  int packets;                   /* number let into the queue */
+  int drops;                     /* number dropped by the queue, full or by RED */
+  int lost;                      /* number lost on the link */
+  int maxqueue;                  /* the most packets ever in the queue */
+  double delay;                  /* sum of the times packets waited in the queue */
+  double busy;                   /* sum of the times the link spent sending */
+};
+
+static struct link links[NPATHS][2][HOPS]; /* each path's links, carrying A's packets and carrying B's */
+
+int TRACE = 3;
 
 /* statistics updated by emulator */
 static int packets_lost;  
@@ -77,13 +269,56 @@ static int messages_delivered;
 static int nsim = 0;              /* number of messages from 5 to 4 so far */ 
 static int nsimmax = 0;           /* number of msgs to generate, then stop */
 static float time = 0.000;
-static float lossprob;            /* probability that a packet is dropped  */
-static float corruptprob;   /* probability that one bit is packet is flipped */
-static int corruptdirection; /* A->B A<-B or bidirectional corruption/loss */
 static float lambda;        /* arrival rate of messages from layer 5 */   
 static int   ntolayer3;           /* number sent into layer 3 */
+static int   ntolayer3from[2];    /* number sent into layer 3 by A and by B */
+static float enteredloss, enteredcorrupt, enteredlambda; /* as entered, for a scenario to recover to */
+static float outageend;           /* when the scenario's outage ends */
+static int outagelost;            /* number lost to outages */
 static int   nlost;               /* number lost in media */
 static int ncorrupt;              /* number corrupted by media*/
+static int lostfrom[2];           /* number lost out of A and out of B */
+static int corruptfrom[2];        /* number corrupted out of A and out of B */
+static int arrivedfrom[2];        /* number out of A and out of B that got across */
+static double delayfrom[2];       /* sum of the times they took */
+static int lossrun[2];            /* packets lost in a row so far out of A or B */
+static int lossbursts;            /* number of runs of consecutive losses */
+static int longestburst;          /* the longest run of consecutive losses */
+static int bitsflipped;           /* number of bits flipped by bit errors */
+static int nheldback;             /* number held back to arrive out of order */
+static int nduplicated;           /* number delivered twice */
+static int unneeded_resends;      /* number of data packets that arrived again, not as a channel copy */
+static int reorder_resends;       /* of those, the number whose first copy arrived out of order */
+static int router_drops;          /* number dropped by a full router queue */
+static int red_drops;             /* number dropped early by RED */
+static int router_packets;        /* number let into a router queue */
+static double router_delay;       /* sum of the times they waited for the link */
+static int router_maxqueue;       /* the most packets ever in a router queue */
+static int path_sent[NPATHS];     /* number sent on each path */
+static int path_lost[NPATHS];     /* number lost on each path */
+static int path_arrived[NPATHS];  /* number that got through each path */
+static double path_transit[NPATHS]; /* sum of the times they took */
+static int input_batches;         /* number of calls handing over more than one packet */
+
+/* each entity's timer.  Stopping it leaves its event in the list, and
+   starting it again keeps that event if it goes off no later than the
+   slack allows, so a protocol that rearms its timer on every ACK does not
+   take an event out of the list and put a new one in each time.  An event
+   that comes up before its timer is due is put back for when it is, and
+   one whose timer was stopped is dropped */
+static float timerdue[2];           /* when A's and B's timers are due, -1 if stopped */
+static float timerslack[2];         /* how late they may go off */
+static struct event *timerevent[2]; /* their events in the list, NULL if none */
+static int timer_calls;             /* number of times a timer was started or stopped */
+static int timer_events;            /* number of timer events put in, taken out or put back */
+static int batched_packets;       /* number of packets handed over in them */
+static long wire_header;          /* bytes of data packet headers sent, in the compact wire format */
+static long wire_payloadbytes;    /* bytes of data packet payloads sent */
+static long wire_ACKbytes;        /* bytes of ACKs and NAKs sent */
+static long wire_paritybytes;     /* bytes of FEC parity packets sent */
+static long wire_resentbytes;     /* bytes of data packets sent again, of the header and payload bytes */
+static long fixed_bytes;          /* bytes all of those would have taken in the fixed format */
+static long fixed_payloadbytes;   /* of those, the data packet payloads */
 
 /****************************************************************************/
 /* jimsrand(): return a double in range [0,1].  The routine below is used to */
@@ -104,7 +339,9 @@ double jimsrand(void)
 /*  The next set of routines handle the event list   */
 /*****************************************************/
 
-void insertevent(struct event *p)
+/* insert p into the event list, searching forward from start.  start must */
+/* be NULL (search from the front) or an event no later than p            */
+static void insertevent_from(struct event *p, struct event *start)
 {
   struct event *q,*qold;
 
@@ -112,7 +349,7 @@ void insertevent(struct event *p)
     printf("            INSERTEVENT: time is %f\n",time);
     printf("            INSERTEVENT: future time will be %f\n",p->evtime); 
   }
-  q = evlist;     /* q points to front of list in which p struct inserted */
+  q = (start != NULL) ? start : evlist; /* q points to where the search starts */
   if (q==NULL) {   /* list is empty */
     evlist=p;
     p->next=NULL;
@@ -141,6 +378,11 @@ void insertevent(struct event *p)
   }
 }
 
+void insertevent(struct event *p)
+{
+  insertevent_from(p, NULL);
+}
+
 void generate_next_arrival(void)
 {
   double x;
@@ -175,10 +417,271 @@ void printevlist(void)
   printf("--------------\n");
 }
 
+/* read SCENARIOFILE and schedule its phases */
+static void readscenario(void)
+{
+  FILE *f;
+  char line[256], word[16], percent[2];
+  char *p;
+  struct event *evptr;
+  float start, value;
+  int i, n, kind;
+
+  f = fopen(SCENARIOFILE, "r");
+  if (f == NULL) {
+    printf("can not read the scenario %s\n", SCENARIOFILE);
+    exit(EXIT_FAILURE);
+  }
+  nphases = 0;
+  while (fgets(line, sizeof line, f) != NULL) {
+    if ((p = strchr(line, '#')) != NULL)
+      *p = '\0';
+    p = line + strspn(line, " \t");
+    if (strncmp(p, "t=", 2) == 0)
+      p += 2;
+    n = sscanf(p, "%f %15s %f%1[%]", &start, word, &value, percent);
+    if (n <= 0)
+      continue;
+    kind = -1;
+    for (i = 0; i <= PHASERECOVER; i++)
+      if (n >= 2 && strcmp(word, phasenames[i]) == 0)
+        kind = i;
+    if (kind < 0 || (kind != PHASERECOVER && n < 3) || nphases == MAXPHASES
+        || (nphases > 0 && start < phases[nphases - 1].start)) {
+      printf("can not make sense of this phase of the scenario %s: %s\n", SCENARIOFILE, line);
+      exit(EXIT_FAILURE);
+    }
+    phases[nphases].start = start;
+    phases[nphases].kind = kind;
+    phases[nphases].value = n < 3 ? 0.0 : n == 4 ? value / 100.0 : value;
+    nphases++;
+  }
+  fclose(f);
+
+  for (i = 0; i < nphases; i++) {
+    evptr = malloc(sizeof(struct event));
+    if (evptr == 0) {
+      printf("memory allocation for event failed.");
+      exit(EXIT_FAILURE);
+    }
+    evptr->evtime = phases[i].start;
+    evptr->evtype = SCENARIO_PHASE;
+    evptr->eventity = i;
+    insertevent(evptr);
+  }
+}
+
+/* a phase of the scenario begins */
+static void beginphase(int i)
+{
+  struct phase *ph = &phases[i];
+
+  if (TRACE>0)
+    printf("          SCENARIO: phase %d, %s %f\n", i, phasenames[ph->kind], ph->value);
+  curphase = i;
+  ph->delivered = messages_delivered;
+  ph->resent = packets_resent;
+  ph->firstdelivery = -1;
+  switch (ph->kind) {
+  case PHASELOSS:
+    lossprob = ph->value;
+    break;
+  case PHASECORRUPT:
+    corruptprob = ph->value;
+    break;
+  case PHASELAMBDA:
+    lambda = ph->value;
+    break;
+  case PHASEOUTAGE:
+    outageend = time + ph->value;
+    break;
+  default:
+    lossprob = enteredloss;
+    corruptprob = enteredcorrupt;
+    lambda = enteredlambda;
+    outageend = time;
+    break;
+  }
+}
+
+/* whether only scenario phases are left to happen, with nothing left to
+   send, so that the run is over */
+static int onlyphasesleft(void)
+{
+  struct event *q;
+
+  if (nsim < nsimmax)
+    return 0;
+  for (q = evlist; q != NULL; q = q->next)
+    if (q->evtype != SCENARIO_PHASE && !(q->evtype == TIMER_INTERRUPT && timerdue[q->eventity] < 0))
+      return 0;
+  return 1;
+}
+
+/********************* DELIVERY VERIFIER ***********************/
+
+/* the n'th generated message */
+static void genmessage(int n, char data[20])
+{
+  char digits[11];
+
+  memset(data, 'a' + n % 26, 10);
+  snprintf(digits, sizeof digits, "%010d", n);
+  memcpy(data + 10, digits, 10);
+}
+
+static void verifyproblem(int AorB, const char *what, int n)
+{
+  if (verify_shown++ < VERIFYSHOW)
+    printf("VERIFY: at time %f, %s: message %d delivered at %s \n", time, what, n, AorB == A ? "A" : "B");
+}
+
+static void verifydelivery(int AorB, char data[20])
+{
+  char sent[20];
+  long n = 0;
+  int i, f, state;
+
+  for (i = 10; i < 20 && data[i] >= '0' && data[i] <= '9'; i++)
+    n = n * 10 + data[i] - '0';
+  if (i < 20 || n >= nsim) {
+    verify_mismatches++;
+    verifyproblem(AorB, "not a message that was sent", -1);
+    return;
+  }
+  genmessage(n, sent);
+  state = msgstate[n] & ~MSGTOB;
+  if (state == MSGDELIVERED) {
+    verify_duplicates++;
+    verifyproblem(AorB, "duplicate", n);
+    return;
+  }
+  if (memcmp(data, sent, 20) != 0 || state != MSGSENT || (msgstate[n] & MSGTOB ? B : A) != AorB) {
+    verify_mismatches++;
+    verifyproblem(AorB, state == MSGDROPPED ? "the sender dropped it" : "not as it was sent", n);
+    return;
+  }
+  msgstate[n] = MSGDELIVERED | (msgstate[n] & MSGTOB);
+
+  /* each flow's messages must come in the order they were generated */
+  f = n % NFLOWS;
+  if (n < nextmsg[AorB][f]) {
+    verify_skipped++;
+    verifyproblem(AorB, "out of order, after a later one", n);
+    return;
+  }
+  for (i = nextmsg[AorB][f]; i < n; i += NFLOWS)
+    if ((msgstate[i] & ~MSGTOB) == MSGSENT && (msgstate[i] & MSGTOB ? B : A) == AorB)
+      verifyproblem(AorB, "a gap, an earlier one is missing", n);
+  nextmsg[AorB][f] = n + NFLOWS;
+}
+
+/* what was left undelivered, and the problems found.  Returns whether
+   there were none */
+static int verifyreport(void)
+{
+  int gaps = 0;
+  int n;
+
+  for (n = 0; n < nsim; n++)
+    if ((msgstate[n] & ~MSGTOB) == MSGSENT)
+      gaps++;
+  n = gaps + verify_skipped + verify_duplicates + verify_mismatches;
+  printf("delivery check:  %d never delivered, %d out of order, %d duplicates, %d not as sent:  %s \n",
+         gaps, verify_skipped, verify_duplicates, verify_mismatches, n > 0 ? "FAILED" : "passed");
+  return n == 0;
+}
+
+/********************* FILE TRANSFER MODE ***********************/
+
+static unsigned long long fnv(unsigned long long hash, const unsigned char *p, long n)
+{
+  long i;
+
+  for (i = 0; i < n; i++)
+    hash = (hash ^ p[i]) * FNVPRIME;
+  return hash;
+}
+
+/* map INFILE and create OUTFILE.  Returns the number of messages to send */
+static int openfiles(void)
+{
+  struct stat st;
+  int fd;
+
+  if (NFLOWS > 1 || BIDIRECTIONAL) {
+    printf("file mode sends one stream: NFLOWS must be 1 and BIDIRECTIONAL 0\n");
+    exit(EXIT_FAILURE);
+  }
+  fd = open(INFILE, O_RDONLY);
+  if (fd < 0 || fstat(fd, &st) < 0) {
+    printf("can not read the file %s\n", INFILE);
+    exit(EXIT_FAILURE);
+  }
+  filesize = st.st_size;
+  filedata = NULL;
+  if (filesize > 0) {
+    filedata = mmap(NULL, filesize, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (filedata == MAP_FAILED) {
+      printf("can not map the file %s\n", INFILE);
+      exit(EXIT_FAILURE);
+    }
+    madvise((void *)filedata, filesize, MADV_SEQUENTIAL);
+  }
+  close(fd);
+  outfile = fopen(OUTFILE, "wb");
+  if (outfile == NULL) {
+    printf("can not write the file %s\n", OUTFILE);
+    exit(EXIT_FAILURE);
+  }
+  filehash = fnv(FNVBASIS, filedata, filesize);
+  outhash = FNVBASIS;
+  filewritten = 0;
+  return (filesize + 19) / 20;
+}
+
+/* the n'th message of the file; the last is padded with zeros */
+static void filemessage(int n, char data[20])
+{
+  long left = filesize - 20L * n;
+
+  memset(data, 0, 20);
+  memcpy(data, filedata + 20L * n, left < 20 ? left : 20);
+}
+
+/* write a message B delivered, less any padding past the end of the file */
+static void filedeliver(char data[20])
+{
+  long n = filesize - filewritten;
+
+  if (n > 20)
+    n = 20;
+  if (n <= 0) {
+    filewritten += 20;      /* more than the file held: it can not match */
+    return;
+  }
+  fwrite(data, 1, n, outfile);
+  outhash = fnv(outhash, (unsigned char *)data, n);
+  filewritten += n;
+}
+
+/* check what was delivered against the file.  Returns whether it matches */
+static int filereport(void)
+{
+  int ok = filewritten == filesize && outhash == filehash;
+
+  fclose(outfile);
+  printf("file %s to %s:  %ld of %ld bytes delivered, hash %016llx, %s \n", INFILE, OUTFILE,
+         filewritten, filesize, outhash, ok ? "matches" : "DOES NOT MATCH");
+  printf("goodput:  %f MB/s, over %f simulated seconds \n",
+         time > 0.0 ? filewritten / (time * TIMEUNIT) / 1e6 : 0.0, time * TIMEUNIT);
+  return ok;
+}
+
 void init(void)                         /* initialize the simulator */
 {
   float sum, avg;
-  int i;
+  int i, j, k;
 
   printf("-----  Stop and Wait Network Simulator Version 1.1 -------- \n\n");
   printf("Enter the number of messages to simulate: ");
@@ -187,7 +690,7 @@ void init(void)                         /* initialize the simulator */
   scanf("%f",&lossprob);
   printf("Enter packet corruption probability [0.0 for no corruption]:");
   scanf("%f",&corruptprob);
-  if (lossprob != 0.0 || corruptprob != 0.0) {
+  if (lossprob != 0.0 || corruptprob != 0.0 || SCENARIO) {
     printf("If you want loss or corruption to only occur in one direction, choose the direction: 0 A->B, 1 A<-B, 2 A<->B (both directions) :");
     scanf("%d",&corruptdirection);
   }
@@ -195,6 +698,22 @@ void init(void)                         /* initialize the simulator */
   scanf("%f",&lambda);
   printf("Enter TRACE:");
   scanf("%d",&TRACE);
+  if (FILEMODE)
+    nsimmax = openfiles();
+  msgstate = NULL;
+  if (VERIFY && !FILEMODE) {
+    msgstate = calloc(nsimmax + 1, 1);
+    if (msgstate == NULL) {
+      printf("no memory to verify %d messages\n", nsimmax);
+      exit(EXIT_FAILURE);
+    }
+    for (i = 0; i < NFLOWS; i++)
+      nextmsg[A][i] = nextmsg[B][i] = i;
+    verify_skipped = 0;
+    verify_duplicates = 0;
+    verify_mismatches = 0;
+    verify_shown = 0;
+  }
 
 
   srand(9999);              /* init random number generator */
@@ -215,6 +734,33 @@ void init(void)                         /* initialize the simulator */
   packets_resent = 0;
   new_ACKs = 0;
   packets_received = 0;
+  packets_ACKed = 0;
+  total_ACK_delay = 0.0;
+  ACKs_piggybacked = 0;
+  messages_queued = 0;
+  queue_full = 0;
+  queue_blocked = 0;
+  max_queue_depth = 0;
+  total_queue_depth = 0.0;
+  total_queue_delay = 0.0;
+  NAKs_sent = 0;
+  NAK_resends = 0;
+  packets_packed = 0;
+  messages_packed = 0;
+  hol_held = 0;
+  hol_delay = 0.0;
+  for (i = 0; i < NFLOWS; i++) {
+    flow_offered[i] = 0;
+    flow_delivered[i] = 0;
+    flow_dropped[i] = 0;
+    flow_resent[i] = 0;
+    flow_ACKed[i] = 0;
+    flow_ACK_delay[i] = 0.0;
+  }
+  fec_data_sent = 0;
+  parity_sent = 0;
+  fec_recovered = 0;
+  fec_time_saved = 0.0;
   packets_lost = 0;  
   packets_corrupt = 0;
   packets_sent = 0;
@@ -222,155 +768,565 @@ void init(void)                         /* initialize the simulator */
   messages_delivered = 0;
 
   ntolayer3 = 0;
+  ntolayer3from[A] = 0;
+  ntolayer3from[B] = 0;
   nlost = 0;
   ncorrupt = 0;
+  for (i = 0; i < 2; i++) {
+    lostfrom[i] = 0;
+    corruptfrom[i] = 0;
+    arrivedfrom[i] = 0;
+    delayfrom[i] = 0.0;
+  }
+  for (i = 0; i < 2; i++)
+    lossrun[i] = 0;
+  lossbursts = 0;
+  longestburst = 0;
+  bitsflipped = 0;
+  nheldback = 0;
+  nduplicated = 0;
+  unneeded_resends = 0;
+  reorder_resends = 0;
+  for (i = 0; i < 2; i++)
+    for (j = 0; j < NFLOWS; j++)
+      for (k = 0; k < ARRIVALSLOTS; k++)
+        arrivals[i][j][k].seqnum = -1;
+  channel_init();
+  router_drops = 0;
+  red_drops = 0;
+  router_packets = 0;
+  router_delay = 0.0;
+  router_maxqueue = 0;
+  for (k = 0; k < NPATHS; k++)
+    for (i = 0; i < 2; i++)
+      for (j = 0; j < HOPS; j++) {
+        links[k][i][j].first = 0;
+        links[k][i][j].count = 0;
+        links[k][i][j].avgqueue = 0.0;
+        links[k][i][j].sincedrop = 0;
+        links[k][i][j].packets = 0;
+        links[k][i][j].drops = 0;
+        links[k][i][j].lost = 0;
+        links[k][i][j].maxqueue = 0;
+        links[k][i][j].delay = 0.0;
+        links[k][i][j].busy = 0.0;
+      }
+  if (NPATHS > (int)(sizeof paths / sizeof paths[0])) {
+    printf("NPATHS is %d but only %d paths are described\n", NPATHS, (int)(sizeof paths / sizeof paths[0]));
+    exit(EXIT_FAILURE);
+  }
+  for (k = 0; k < NPATHS; k++) {
+    path_sent[k] = 0;
+    path_lost[k] = 0;
+    path_arrived[k] = 0;
+    path_transit[k] = 0.0;
+  }
+  input_batches = 0;
+  for (i = 0; i < 2; i++) {
+    timerdue[i] = -1;
+    timerevent[i] = NULL;
+  }
+  timer_calls = 0;
+  timer_events = 0;
+  batched_packets = 0;
+  wire_header = 0;
+  wire_payloadbytes = 0;
+  wire_ACKbytes = 0;
+  wire_paritybytes = 0;
+  wire_resentbytes = 0;
+  fixed_bytes = 0;
+  fixed_payloadbytes = 0;
+
+  enteredloss = lossprob;
+  enteredcorrupt = corruptprob;
+  enteredlambda = lambda;
+  outageend = 0.0;
+  outagelost = 0;
+  curphase = -1;
 
   time=0.0;                    /* initialize time to 0.0 */
+  if (SCENARIO)
+    readscenario();
   generate_next_arrival();     /* initialize event list */
 }
 
 /********************** Student-callable ROUTINES ***********************/
 
+/* called by students routine to read the current simulation time */
+float gettime(void)
+{
+  return time;
+}
+
 /* called by students routine to cancel a previously-started timer */
+/* take an event out of the list */
+static void removeevent(struct event *q)
+{
+  if (q->next==NULL && q->prev==NULL)
+    evlist=NULL;         /* remove first and only event on list */
+  else if (q->next==NULL) /* end of list - there is one in front */
+    q->prev->next = NULL;
+  else if (q==evlist) { /* front of list - there must be event after */
+    q->next->prev=NULL;
+    evlist = q->next;
+  }
+  else {     /* middle of list */
+    q->next->prev = q->prev;
+    q->prev->next =  q->next;
+  }
+}
+
 void stoptimer(int AorB)
 /* A or B is trying to stop timer */
 {
-  struct event *q;
-
   if (TRACE>1)
     printf("          STOP TIMER: stopping timer at %f\n",time);
-  /* for (q=evlist; q!=NULL && q->next!=NULL; q = q->next)  */
-  for (q=evlist; q!=NULL ; q = q->next) 
-    if ( (q->evtype==TIMER_INTERRUPT  && q->eventity==AorB) ) { 
-      /* remove this event */
-      if (q->next==NULL && q->prev==NULL)
-        evlist=NULL;         /* remove first and only event on list */
-      else if (q->next==NULL) /* end of list - there is one in front */
-        q->prev->next = NULL;
-      else if (q==evlist) { /* front of list - there must be event after */
-        q->next->prev=NULL;
-        evlist = q->next;
-      }
-      else {     /* middle of list */
-        q->next->prev = q->prev;
-        q->prev->next =  q->next;
-      }
-      free(q);
-      return;
-    }
-  printf("Warning: unable to cancel your timer. It wasn't running.\n");
+  if (timerdue[AorB] < 0) {
+    printf("Warning: unable to cancel your timer. It wasn't running.\n");
+    return;
+  }
+  /* its event stays in the list, in case the timer is started again */
+  timerdue[AorB] = -1;
+  timer_calls++;
 }
 
 
 void starttimer(int AorB, double increment)
 /* A or B is trying to start timer */
 {
+  starttimer_slack(AorB, increment, 0.0);
+}
 
-  struct event *q;
+void starttimer_slack(int AorB, double increment, double slack)
+/* A or B is trying to start a timer that may go off up to slack late */
+{
   struct event *evptr;
 
   if (TRACE>1)
     printf("          START TIMER: starting timer at %f\n",time);
   /* be nice: check to see if timer is already started, if so, then  warn */
-  /* for (q=evlist; q!=NULL && q->next!=NULL; q = q->next)  */
-  for (q=evlist; q!=NULL ; q = q->next)  
-    if ( (q->evtype==TIMER_INTERRUPT  && q->eventity==AorB) ) { 
-      printf("Warning: attempt to start a timer that is already started\n");
-      return;
+  if (timerdue[AorB] >= 0) {
+    printf("Warning: attempt to start a timer that is already started\n");
+    return;
+  }
+  timer_calls++;
+  timerdue[AorB] = increment > 0.0 ? time + increment : time;
+  timerslack[AorB] = slack > 0.0 ? slack : 0.0;
+
+  /* an event still in the list will do if it goes off early, as it is put
+     back then, or late by no more than the slack */
+  evptr = timerevent[AorB];
+  if (evptr != NULL && evptr->evtime <= timerdue[AorB] + timerslack[AorB])
+    return;
+  if (evptr != NULL) {
+    removeevent(evptr);
+    timer_events++;
+  }
+  else {
+    /* create future event for when timer goes off */
+    evptr = malloc(sizeof(struct event));
+    if (evptr == 0) {
+      printf("memory allocation for event failed.");
+      exit(EXIT_FAILURE);
     }
- 
-  /* create future event for when timer goes off */
-  evptr = malloc(sizeof(struct event));
-  if (evptr == 0) {
-    printf("memory allocation for event failed.");
-    exit(EXIT_FAILURE);
+    evptr->evtype =  TIMER_INTERRUPT;
+    evptr->eventity = AorB;
   }
-  evptr->evtime =  time + increment;
-  evptr->evtype =  TIMER_INTERRUPT;
-   
- 
-  evptr->eventity = AorB;
+  evptr->evtime =  timerdue[AorB] + timerslack[AorB];
   insertevent(evptr);
-} 
+  timerevent[AorB] = evptr;
+  timer_events++;
+}
 
+/* a timer event has come up.  Returns whether it is to be passed over:
+   dropped, if its timer has been stopped, or put back, if its timer is not
+   due yet.  Otherwise the timer goes off, and is no longer running */
+static int timerpassedover(struct event *evptr)
+{
+  int AorB = evptr->eventity;
 
-/************************** TOLAYER3 ***************/
-void tolayer3(int AorB, struct pkt packet)
-/* A or B is sending to network  */
+  timerevent[AorB] = NULL;
+  if (timerdue[AorB] < 0) {
+    free(evptr);
+    timer_events++;
+    return 1;
+  }
+  if (evptr->evtime < timerdue[AorB]) {
+    evptr->evtime = timerdue[AorB] + timerslack[AorB];
+    insertevent(evptr);
+    timerevent[AorB] = evptr;
+    timer_events++;
+    return 1;
+  }
+  timerdue[AorB] = -1;
+  return 0;
+}
+
+
+/************************** LINK MODEL ***************/
+
+/* RED: decide whether to drop a packet arriving at time now at a queue
+   of count packets, from the moving average of the queue length */
+static int redearlydrop(struct link *l, const struct hop *h, float now)
 {
-  struct pkt *mypktptr;
-  struct event *evptr,*q;
-  float lastime, x;
-  int i;
+  double pb, pa;
+
+  if (l->count == 0 && l->avgqueue > 0.0) {
+    /* the queue has been idle.  Decay the average as if the link had
+       gone on sending small packets since it emptied, so an idle link
+       does not carry a stale average into the next burst */
+    float idle = now - l->departure[(l->first + ROUTERQUEUE - 1) % ROUTERQUEUE];
+    int m = idle * h->bandwidth / (HEADERBYTES + 20);
+    while (m-- > 0 && l->avgqueue > 0.01)
+      l->avgqueue *= 1.0 - REDWEIGHT;
+  }
+  l->avgqueue = (1.0 - REDWEIGHT) * l->avgqueue + REDWEIGHT * l->count;
+
+  if (l->avgqueue < REDMIN) {
+    l->sincedrop = 0;
+    return 0;
+  }
+  if (l->avgqueue >= REDMAX)
+    return 1;
+
+  /* spread the drops out: the longer since the last one, the likelier */
+  pb = REDMAXP * (l->avgqueue - REDMIN) / (REDMAX - REDMIN);
+  pa = l->sincedrop * pb < 1.0 ? pb / (1.0 - l->sincedrop * pb) : 1.0;
+  return jimsrand() < pa;
+}
+
+/* offer a packet reaching hop h's router queue at time now.  Returns 0
+   if the queue drops it, otherwise sets arrival to when it reaches the
+   far end of the link */
+static int linksend(struct link *l, const struct hop *h, int hop, struct pkt *packet, float now, float *arrival)
+{
+  float start, sending = wiresize(packet) / h->bandwidth;
+
+  /* packets the link has finished sending have left the queue */
+  while (l->count > 0 && l->departure[l->first] <= now) {
+    l->first = (l->first + 1) % ROUTERQUEUE;
+    l->count--;
+  }
+
+  if (RED && redearlydrop(l, h, now)) {
+    red_drops++;
+    l->drops++;
+    l->sincedrop = 0;
+    if (TRACE>0)
+      printf("          TOLAYER3: packet dropped early by RED at hop %d\n", hop + 1);
+    return 0;
+  }
+  if (l->count == h->queue || l->count == ROUTERQUEUE) {
+    router_drops++;
+    l->drops++;
+    l->sincedrop = 0;
+    if (TRACE>0)
+      printf("          TOLAYER3: router queue full at hop %d, packet dropped\n", hop + 1);
+    return 0;
+  }
+
+  /* the link sends one packet at a time, in the order they arrive */
+  if (l->count > 0)
+    start = l->departure[(l->first + l->count - 1) % ROUTERQUEUE];
+  else
+    start = now;
+  l->departure[(l->first + l->count) % ROUTERQUEUE] = start + sending;
+  l->count++;
+  l->sincedrop++;
+
+  router_packets++;
+  router_delay += start - now;
+  if (l->count > router_maxqueue)
+    router_maxqueue = l->count;
+  l->packets++;
+  l->delay += start - now;
+  l->busy += sending;
+  if (l->count > l->maxqueue)
+    l->maxqueue = l->count;
+
+  *arrival = start + sending + h->propdelay;
+  return 1;
+}
+
+/* pass a packet sent by A or B along the chain of hops of a path.  Returns 0 if a
+   router drops it or a link loses it, otherwise sets arrival to when it
+   reaches the other side.  Every link is first in first out and nothing
+   else joins the chain part way, so packets reach each router in the
+   order they were sent, and the whole passage can be worked out now:
+   each queue is as the packets sent before this one left it */
+static int chainsend(int AorB, int path, struct pkt *packet, float *arrival)
+{
+  float at = time;
+  int i, hop;
+
+  for (i = 0; i < HOPS; i++) {
+    hop = AorB == A ? i : HOPS - 1 - i;
+    if (!linksend(&links[path][AorB][hop], &hops[hop], hop, packet, at, &at))
+      return 0;
+    if (hops[hop].loss > 0.0 && jimsrand() < hops[hop].loss) {
+      links[path][AorB][hop].lost++;
+      if (TRACE>0)
+        printf("          TOLAYER3: packet lost on the link at hop %d\n", hop + 1);
+      return 0;
+    }
+  }
+  *arrival = at;
+  return 1;
+}
+
+
+/* true if a packet arriving from the channel overtook one held back */
+static int overtook(struct event *arrived)
+{
+  struct event *q;
 
-  ntolayer3++;
+  for (q=evlist; q!=NULL ; q = q->next)
+    if (q->evtype==FROM_LAYER3 && q->eventity==arrived->eventity && q->heldback
+        && q->sendno < arrived->sendno)
+      return 1;
+  return 0;
+}
+
+/* note a packet arriving from the channel, counting it if it is a data
+   packet that had arrived intact before */
+static void notearrival(struct event *arrived)
+{
+  struct pkt *packet = arrived->pktptr;
+  struct arrival *a;
+  int from = (arrived->eventity + 1) % 2;
 
-  /* simulate losses: */
-  if (jimsrand() < lossprob && (!(AorB == B && corruptdirection == A) && !(AorB == A && corruptdirection == B))) {
-    nlost++;
-    if (TRACE>0)    
-      printf("          TOLAYER3: packet being lost\n");
+  /* only intact data packets, not ACKs or parity */
+  if (arrived->corrupted || packet->seqnum < 0 || packet->flow < 0 || packet->flow >= NFLOWS)
+    return;
+  if (FECPARITY(packet->fec))
     return;
-  }  
 
-  /* make a copy of the packet student just gave me since he/she may decide */
-  /* to do something with the packet after we return back to him/her */ 
-  mypktptr = malloc(sizeof(struct pkt));
-  if (mypktptr == 0) {
-    printf("memory allocation for event failed.");
-    exit(EXIT_FAILURE);
+  a = &arrivals[from][packet->flow][packet->seqnum % ARRIVALSLOTS];
+  if (a->seqnum == packet->seqnum && a->nmsgs == packet->nmsgs
+      && memcmp(a->payload, packet->payload, 20 * packet->nmsgs) == 0) {
+    /* the same packet again.  Unless the channel copied it, or it is a
+       held back transmission the channel's copy of which got there first,
+       it was resent when a copy had already got through */
+    if (!arrived->duplicate && arrived->sendno != a->sendno) {
+      unneeded_resends++;
+      if (a->reordered)
+        reorder_resends++;
+    }
+    return;
   }
-  mypktptr->seqnum = packet.seqnum;
-  mypktptr->acknum = packet.acknum;
-  mypktptr->checksum = packet.checksum;
-  for (i=0; i<20; i++)
-    mypktptr->payload[i] = packet.payload[i];
-  if (TRACE>2)  {
-    printf("          TOLAYER3: seq: %d, ack %d, check: %d ", mypktptr->seqnum,
-           mypktptr->acknum,  mypktptr->checksum);
-    for (i=0; i<20; i++)
-      printf("%c",mypktptr->payload[i]);
-    printf("\n");
+
+  a->seqnum = packet->seqnum;
+  a->nmsgs = packet->nmsgs;
+  a->sendno = arrived->sendno;
+  memcpy(a->payload, packet->payload, 20 * packet->nmsgs);
+  a->reordered = arrived->heldback || (REORDERPROB > 0.0 && overtook(arrived));
+}
+
+
+/************************** TOLAYER3 ***************/
+void tolayer3(int AorB, struct pkt packet)
+/* A or B is sending to network  */
+{
+  tolayer3_batch(AorB, &packet, 1);
+}
+
+/* count the bytes a packet takes on the wire, in the compact format and
+   in the fixed one, by what they carry */
+static void countbytes(struct pkt *packet)
+{
+  unsigned char buf[WIREMAX];
+  int size = wire_encode(packet, buf);
+  int payload;
+
+  fixed_bytes += wiresize(packet);
+  if (FECPARITY(packet->fec))
+    wire_paritybytes += size;
+  else if (packet->seqnum < 0)
+    wire_ACKbytes += size;
+  else {
+    payload = wire_payload(packet);
+    wire_header += size - payload;
+    wire_payloadbytes += payload;
+    fixed_payloadbytes += wiresize(packet) - HEADERBYTES;
+    if (packet->resent)
+      wire_resentbytes += size;
   }
+}
 
-  /* create future event for arrival of packet at the other side */
-  evptr = malloc(sizeof(struct event));
-  if (evptr == 0) {
-    printf("memory allocation for event failed.");
-    exit(EXIT_FAILURE);
+void tolayer3_batch(int AorB, struct pkt packets[], int count)
+/* A or B is sending a burst of packets to network.  The channel is scanned */
+/* once for the latest pending arrival, and each packet is then scheduled   */
+/* behind the one before it, so the burst costs a single pass of the list   */
+{
+  struct pkt *mypktptr;
+  struct event *evptr,*q,*copy;
+  struct event *tail[NPATHS];
+  float lastime[NPATHS];
+  float arrival, gap;
+  int i,k,n,p;
+
+  /* a path does not reorder, other than the packets it holds back or
+     copies, so every packet arrives after the latest arrival time of the
+     other packets currently on the same path on their way to the
+     destination.  Find those packets once for the whole burst */
+  for (p = 0; p < NPATHS; p++) {
+    lastime[p] = time;
+    tail[p] = NULL;
   }
-  evptr->evtype =  FROM_LAYER3;   /* packet will pop out from layer3 */
-  evptr->eventity = (AorB+1) % 2; /* event occurs at other entity */
-  evptr->pktptr = mypktptr;       /* save ptr to my copy of packet */
-  /* finally, compute the arrival time of packet at the other end.
-     medium can not reorder, so make sure packet arrives between 1 and 10
-     time units after the latest arrival time of packets
-     currently in the medium on their way to the destination */
-  lastime = time;
-  /* for (q=evlist; q!=NULL && q->next!=NULL; q = q->next) */
   for (q=evlist; q!=NULL ; q = q->next) 
-    if ( (q->evtype==FROM_LAYER3  && q->eventity==evptr->eventity) ) 
-      lastime = q->evtime;
-  evptr->evtime =  lastime + 1 + 9*jimsrand();
- 
+    if ( (q->evtype==FROM_LAYER3  && q->eventity==(AorB+1) % 2) && !q->heldback && !q->duplicate) {
+      lastime[q->pktptr->path] = q->evtime;
+      tail[q->pktptr->path] = q;
+    }
 
+  for (k=0; k<count; k++) {
+    ntolayer3++;
+    ntolayer3from[AorB]++;
+    p = packets[k].path;
+    if (p < 0 || p >= NPATHS)
+      p = 0;
+    path_sent[p]++;
+    countbytes(&packets[k]);
+
+    /* an outage loses everything */
+    if (time < outageend) {
+      nlost++;
+      lostfrom[AorB]++;
+      path_lost[p]++;
+      outagelost++;
+      if (TRACE>0)
+        printf("          TOLAYER3: packet lost in an outage\n");
+      continue;
+    }
 
-  /* simulate corruption: */
-  if ((jimsrand() < corruptprob)  && (!(AorB == B && corruptdirection == A) && !(AorB == A && corruptdirection == B))) {
-    ncorrupt++;
-    if ( (x = jimsrand()) < .75)
-      mypktptr->payload[0]='Z';   /* corrupt payload */
-    else if (x < .875)
-      mypktptr->seqnum = 999999;
+    /* a router on the way may drop it, or a link lose it */
+    if (LINKMODEL && !chainsend(AorB, p, &packets[k], &arrival))
+      continue;
+
+    /* simulate losses: */
+    if (channelloss(AorB) && lossapplies(AorB)) {
+      nlost++;
+      lostfrom[AorB]++;
+      if (++lossrun[AorB] == 1)
+        lossbursts++;
+      if (lossrun[AorB] > longestburst)
+        longestburst = lossrun[AorB];
+      path_lost[p]++;
+      if (TRACE>0)    
+        printf("          TOLAYER3: packet being lost\n");
+      continue;
+    }  
+    lossrun[AorB] = 0;
+    if (paths[p].loss > 0.0 && jimsrand() < paths[p].loss) {
+      nlost++;
+      lostfrom[AorB]++;
+      path_lost[p]++;
+      if (TRACE>0)
+        printf("          TOLAYER3: packet being lost on path %d\n", p);
+      continue;
+    }
+
+    /* make a copy of the packet student just gave me since he/she may decide */
+    /* to do something with the packet after we return back to him/her */ 
+    mypktptr = malloc(sizeof(struct pkt));
+    if (mypktptr == 0) {
+      printf("memory allocation for event failed.");
+      exit(EXIT_FAILURE);
+    }
+    *mypktptr = packets[k];
+    mypktptr->path = p;
+    if (TRACE>2)  {
+      printf("          TOLAYER3: seq: %d, ack %d, check: %d ", mypktptr->seqnum,
+             mypktptr->acknum,  mypktptr->checksum);
+      for (i=0; i<20; i++)
+        printf("%c",mypktptr->payload[i]);
+      printf("\n");
+    }
+
+    /* create future event for arrival of packet at the other side */
+    evptr = malloc(sizeof(struct event));
+    if (evptr == 0) {
+      printf("memory allocation for event failed.");
+      exit(EXIT_FAILURE);
+    }
+    evptr->evtype =  FROM_LAYER3;   /* packet will pop out from layer3 */
+    evptr->eventity = (AorB+1) % 2; /* event occurs at other entity */
+    evptr->pktptr = mypktptr;       /* save ptr to my copy of packet */
+    evptr->sendno = ntolayer3from[AorB];
+    evptr->heldback = 0;
+    evptr->duplicate = 0;
+    evptr->corrupted = 0;
+    /* finally, compute the arrival time of packet at the other end:
+       a channel delay after the previous packet on the path, or as the
+       link model has it, then no sooner than the path's delay.
+       Either way it is no earlier */
+    if (LINKMODEL)
+      evptr->evtime = arrival + paths[p].delay;
+    else if (lastime[p] < time + paths[p].delay)
+      evptr->evtime = time + paths[p].delay + channeldelay(AorB);
     else
-      mypktptr->acknum = 999999;
-    if (TRACE>0)    
-      printf("          TOLAYER3: packet being corrupted\n");
-  }  
+      evptr->evtime =  lastime[p] + channeldelay(AorB);
+    lastime[p] = evptr->evtime;
+    arrivedfrom[AorB]++;
+    delayfrom[AorB] += evptr->evtime - time;
+    path_arrived[p]++;
+    path_transit[p] += evptr->evtime - time;
 
-  if (TRACE>2)  
-    printf("          TOLAYER3: scheduling arrival on other side\n");
-  insertevent(evptr);
+    /* simulate corruption: */
+    if ((n = channelcorrupt(AorB, mypktptr)) > 0) {
+      ncorrupt++;
+      corruptfrom[AorB]++;
+      evptr->corrupted = 1;
+      if (CORRUPTMODEL == 1) {
+        bitsflipped += n;
+        if (TRACE>0)    
+          printf("          TOLAYER3: %d bits flipped in packet\n", n);
+      }
+      else if (TRACE>0)    
+        printf("          TOLAYER3: packet being corrupted\n");
+    }  
+
+    /* about how far apart packets arrive, to hold one back by */
+    gap = LINKMODEL ? wiresize(mypktptr) / BANDWIDTH : 5.5;
+
+    /* simulate duplication: the copy follows close behind */
+    if (DUPPROB > 0.0 && jimsrand() < DUPPROB) {
+      nduplicated++;
+      copy = malloc(sizeof(struct event));
+      if (copy == 0 || (copy->pktptr = malloc(sizeof(struct pkt))) == 0) {
+        printf("memory allocation for event failed.");
+        exit(EXIT_FAILURE);
+      }
+      *copy->pktptr = *mypktptr;
+      copy->evtype = FROM_LAYER3;
+      copy->eventity = evptr->eventity;
+      copy->evtime = evptr->evtime + jimsrand() * gap;
+      copy->sendno = evptr->sendno;
+      copy->heldback = 0;
+      copy->duplicate = 1;
+      copy->corrupted = evptr->corrupted;
+      if (TRACE>0)    
+        printf("          TOLAYER3: packet being duplicated\n");
+      insertevent_from(copy, tail[p]);
+    }
+
+    if (TRACE>2)  
+      printf("          TOLAYER3: scheduling arrival on other side\n");
+    /* simulate reordering: packets sent after this one go ahead of it */
+    if (REORDERPROB > 0.0 && jimsrand() < REORDERPROB) {
+      nheldback++;
+      evptr->heldback = 1;
+      evptr->evtime += jimsrand() * REORDERDEPTH * gap;
+      if (TRACE>0)    
+        printf("          TOLAYER3: packet being held back\n");
+      insertevent_from(evptr, tail[p]);
+      continue;
+    }
+    /* the new arrival is no earlier than the previous one on its path, so
+       resume the search for its place in the event list from there */
+    insertevent_from(evptr, tail[p]);
+    tail[p] = evptr;
+  }
 } 
 
 void tolayer5(int AorB, char datasent[20])
@@ -387,15 +1343,25 @@ void tolayer5(int AorB, char datasent[20])
     printf("\n");
   }
   messages_delivered++;
+  if (FILEMODE && AorB == B)
+    filedeliver(datasent);
+  if (msgstate != NULL)
+    verifydelivery(AorB, datasent);
+  if (curphase >= 0 && phases[curphase].firstdelivery < 0)
+    phases[curphase].firstdelivery = time;
 }
 
 int main(void)
 {
-  struct event *eventptr;
+  struct event *eventptr, *q;
   struct msg  msg2give;
   struct pkt  pkt2give;
+  struct pkt  batch[INPUTBATCH];
    
-  int i,j;
+  int i,j,k;
+  double sum = 0.0, sumsq = 0.0;  /* of the flows' throughputs, for the fairness index */
+  float end;                      /* of a scenario phase */
+  long wirebytes;                 /* sent in the compact wire format */
   
   init();
   A_init();
@@ -405,9 +1371,14 @@ int main(void)
     eventptr = evlist;            /* get next event to simulate */
     if (eventptr==NULL)
       goto terminate;
+    if (eventptr->evtype == SCENARIO_PHASE && onlyphasesleft())
+      goto terminate;
     evlist = evlist->next;        /* remove this event from event list */
     if (evlist!=NULL)
       evlist->prev=NULL;
+    /* a timer event that is not to go off is dealt with before the time moves on */
+    if (eventptr->evtype == TIMER_INTERRUPT && timerpassedover(eventptr))
+      continue;
     if (TRACE>=2) {
       printf("\nEVENT time: %f,",eventptr->evtime);
       printf("  type: %d",eventptr->evtype);
@@ -415,40 +1386,77 @@ int main(void)
         printf(", timerinterrupt  ");
       else if (eventptr->evtype==1)
         printf(", fromlayer5 ");
+      else if (eventptr->evtype==SCENARIO_PHASE)
+        printf(", scenario phase ");
       else
         printf(", fromlayer3 ");
       printf(" entity: %d\n",eventptr->eventity);
     }
     time = eventptr->evtime;        /* update time to next event time */
     if (eventptr->evtype == FROM_LAYER5 ) {
-      if (nsim < nsimmax) {
+      if (FILEMODE && nsim < nsimmax && !A_accepts(0)) {
+        generate_next_arrival();   /* the file's next message waits for room */
+        if (TRACE > 2)
+          printf("          FROM_LAYER5: A can not take the next message yet \n");
+      }
+      else if (nsim < nsimmax) {
         generate_next_arrival();   /* set up future arrival */
-        /* fill in msg to give with string of same letter */    
-        j = nsim % 26; 
-        for (i=0; i<20; i++)  
-          msg2give.data[i] = 97 + j;
+        /* fill in msg to give with string of same letter, then its number */    
+        genmessage(nsim, msg2give.data);
+        if (FILEMODE)
+          filemessage(nsim, msg2give.data);
+        /* messages are dealt to the flows in turn, so each offers the same load */
+        msg2give.flow = nsim % NFLOWS;
+        flow_offered[msg2give.flow]++;
         if (TRACE>2) {
           printf("          MAINLOOP: data given to student: ");
           for (i=0; i<20; i++) 
             printf("%c", msg2give.data[i]);
           printf("\n");
         }
-        nsim++;
+        k = nsim++;
+        j = flow_dropped[msg2give.flow];
         if (eventptr->eventity == A) 
           A_output(msg2give);  
         else
           B_output(msg2give);  
+        /* note whether the sender took it, and where it is to be delivered */
+        if (msgstate != NULL)
+          msgstate[k] = (flow_dropped[msg2give.flow] != j ? MSGDROPPED : MSGSENT) |
+                        (eventptr->eventity == A ? MSGTOB : 0);
       }
       else if (TRACE > 2)
           printf("          FROM_LAYER5: no more messages to send: \n");
     }
     else if (eventptr->evtype ==  FROM_LAYER3) {
-      pkt2give.seqnum = eventptr->pktptr->seqnum;
-      pkt2give.acknum = eventptr->pktptr->acknum;
-      pkt2give.checksum = eventptr->pktptr->checksum;
-      for (i=0; i<20; i++)  
-        pkt2give.payload[i] = eventptr->pktptr->payload[i];
-	    if (eventptr->eventity ==A)      /* deliver packet by calling */
+      notearrival(eventptr);
+      pkt2give = *eventptr->pktptr;
+      /* take the packets arriving at the entity within INPUTWAIT too */
+      for (k = 0; k + 1 < INPUTBATCH && evlist != NULL && evlist->evtype == FROM_LAYER3
+                  && evlist->eventity == eventptr->eventity
+                  && evlist->evtime <= eventptr->evtime + INPUTWAIT; k++) {
+        q = evlist;
+        evlist = q->next;
+        if (evlist != NULL)
+          evlist->prev = NULL;
+        time = q->evtime;
+        notearrival(q);
+        batch[k + 1] = *q->pktptr;
+        free(q->pktptr);
+        free(q);
+      }
+      if (k > 0) {
+        batch[0] = pkt2give;
+        input_batches++;
+        batched_packets += k + 1;
+        if (TRACE>=2)
+          printf("          FROM_LAYER3: %d packets arriving together\n", k + 1);
+        if (eventptr->eventity == A)
+          A_input_batch(batch, k + 1);
+        else
+          B_input_batch(batch, k + 1);
+      }
+	    else if (eventptr->eventity ==A)      /* deliver packet by calling */
         A_input(pkt2give);            /* appropriate entity */
       else
         B_input(pkt2give);
@@ -460,6 +1468,8 @@ int main(void)
       else
         B_timerinterrupt();
     }
+    else if (eventptr->evtype == SCENARIO_PHASE)
+      beginphase(eventptr->eventity);
     else  {
       printf("INTERNAL PANIC: unknown event type \n");
     }
@@ -474,5 +1484,124 @@ int main(void)
   printf("number of packet resends by A:  %d \n", packets_resent);
   printf("number of correct packets received at B:  %d \n", packets_received);
   printf("number of messages delivered to application:  %d \n", messages_delivered);
-  return EXIT_SUCCESS;
-}
\ No newline at end of file
+  printf("number of packets sent into layer 3 by A:  %d \n", ntolayer3from[A]);
+  printf("number of packets sent into layer 3 by B:  %d \n", ntolayer3from[B]);
+  printf("number of ACKs piggybacked on data packets:  %d \n", ACKs_piggybacked);
+  if (messages_queued > 0) {
+    printf("number of messages put in the send queue:  %d \n", messages_queued);
+    printf("number of messages dropped due to full send queue:  %d \n", queue_full);
+    printf("number of times the send queue reached its high watermark:  %d \n", queue_blocked);
+    printf("average send queue depth seen by arriving messages:  %f \n", total_queue_depth / messages_queued);
+    printf("maximum send queue depth:  %d \n", max_queue_depth);
+    printf("average time a message waited in the send queue:  %f \n", total_queue_delay / messages_queued);
+  }
+  if (NAKs_sent > 0) {
+    printf("number of NAKs sent on seeing a gap:  %d \n", NAKs_sent);
+    printf("number of packet resends triggered by a NAK:  %d \n", NAK_resends);
+  }
+  if (LOSSMODEL != 0)
+    printf("number of packets lost in the channel:  %d, in %d bursts, the longest %d \n", nlost, lossbursts, longestburst);
+  if (CORRUPTMODEL != 0)
+    printf("number of packets corrupted by bit errors:  %d, with %d bits flipped \n", ncorrupt, bitsflipped);
+  if (PROFILES)
+    for (i = A; i <= B; i++)
+      printf("channel %s:  %d packets sent, %d lost, %d corrupted, average time to cross %f \n",
+             i == A ? "A->B" : "B->A", ntolayer3from[i], lostfrom[i], corruptfrom[i],
+             arrivedfrom[i] > 0 ? delayfrom[i] / arrivedfrom[i] : 0.0);
+  if (SCENARIO) {
+    printf("number of packets lost to outages:  %d \n", outagelost);
+    /* each phase that began lasted until the next one began, or the end */
+    for (i = 0; i <= curphase; i++) {
+      end = i < curphase ? phases[i + 1].start : time;
+      j = (i < curphase ? phases[i + 1].delivered : messages_delivered) - phases[i].delivered;
+      k = (i < curphase ? phases[i + 1].resent : packets_resent) - phases[i].resent;
+      printf("phase %d, %s %f from time %f:  %d messages delivered, %f per time unit, %d packets resent",
+             i, phasenames[phases[i].kind], phases[i].value, phases[i].start, j,
+             end > phases[i].start ? j / (end - phases[i].start) : 0.0, k);
+      if (phases[i].firstdelivery >= 0)
+        printf(", the first %f after it began \n", phases[i].firstdelivery - phases[i].start);
+      else
+        printf(", none delivered \n");
+    }
+  }
+  if (REORDERPROB > 0.0 || DUPPROB > 0.0) {
+    printf("number of packets held back to arrive out of order:  %d \n", nheldback);
+    printf("number of packets delivered twice:  %d \n", nduplicated);
+  }
+  printf("number of data packets resent when a copy had already arrived intact:  %d \n", unneeded_resends);
+  if (REORDERPROB > 0.0)
+    printf("number of those where the copy had arrived out of order:  %d \n", reorder_resends);
+  if (LINKMODEL) {
+    printf("number of packets dropped by a full router queue:  %d \n", router_drops);
+    if (RED)
+      printf("number of packets dropped early by RED:  %d \n", red_drops);
+    printf("maximum router queue length:  %d \n", router_maxqueue);
+    if (router_packets > 0)
+      printf("average time a packet waited in the router queue:  %f \n", router_delay / router_packets);
+    /* the bottleneck is the hop whose link is busiest and queue longest */
+    if (HOPS > 1 || NPATHS > 1)
+      for (k = 0; k < NPATHS; k++)
+        for (i = 0; i < HOPS; i++)
+          for (j = A; j <= B; j++) {
+            struct link *l = &links[k][j][i];
+            if (NPATHS > 1)
+              printf("path %d ", k);
+            printf("hop %d %s:  %d packets, %d dropped by the router, %d lost, maximum queue %d, average wait %f, link busy %f of the time \n",
+                   i + 1, j == A ? "A->B" : "B->A", l->packets, l->drops, l->lost, l->maxqueue,
+                   l->packets > 0 ? l->delay / l->packets : 0.0, time > 0.0 ? l->busy / time : 0.0);
+          }
+  }
+  if (NPATHS > 1) {
+    for (k = 0; k < NPATHS; k++)
+      printf("path %d:  %d packets sent, %d lost, average time to cross %f \n", k, path_sent[k], path_lost[k],
+             path_arrived[k] > 0 ? path_transit[k] / path_arrived[k] : 0.0);
+    printf("messages delivered per time unit over all the paths:  %f \n", time > 0.0 ? messages_delivered / time : 0.0);
+    printf("number of packets held in a reorder buffer for an earlier packet:  %d \n", hol_held);
+    if (hol_held > 0)
+      printf("average time they were held (head-of-line blocking):  %f \n", hol_delay / hol_held);
+  }
+  if (timer_calls > 0)
+    printf("timer events put in, taken out or put back in the event list:  %d, for %d timer starts and stops, %d saved \n",
+           timer_events, timer_calls, timer_calls - timer_events);
+  if (input_batches > 0)
+    printf("number of times packets arriving together were handed over in one call:  %d, %f packets each \n",
+           input_batches, (double)batched_packets / input_batches);
+  if (packets_packed > 0)
+    printf("average number of messages packed in a data packet:  %f \n", (double)messages_packed / packets_packed);
+  if (parity_sent > 0) {
+    printf("number of FEC parity packets sent:  %d (%f per data packet) \n", parity_sent, (double)parity_sent / fec_data_sent);
+    printf("number of data packets rebuilt from parity without a resend:  %d \n", fec_recovered);
+    printf("estimated time saved by rebuilt packets (one timeout each):  %f \n", fec_time_saved);
+  }
+  printf("bytes sent into layer 3:  %ld in data packet headers, %ld of payload, %ld in ACKs, %ld in parity, %ld of them resent \n",
+         wire_header, wire_payloadbytes, wire_ACKbytes, wire_paritybytes, wire_resentbytes);
+  wirebytes = wire_header + wire_payloadbytes + wire_ACKbytes + wire_paritybytes;
+  printf("payload share of the bytes on the wire:  %f, %f in the fixed %d byte header format \n",
+         wirebytes > 0 ? (double)wire_payloadbytes / wirebytes : 0.0,
+         fixed_bytes > 0 ? (double)fixed_payloadbytes / fixed_bytes : 0.0, HEADERBYTES);
+  if (messages_delivered > 0)
+    printf("bytes on the wire per message delivered:  %f, %f in the fixed format \n",
+           (double)wirebytes / messages_delivered, (double)fixed_bytes / messages_delivered);
+  if (packets_ACKed > 0)
+    printf("average time from first sending a packet to its ACK at A:  %f \n", total_ACK_delay / packets_ACKed);
+  if (NFLOWS > 1) {
+    for (i = 0; i < NFLOWS; i++) {
+      printf("flow %d: offered %d, delivered %d, dropped %d, resent %d, throughput %f",
+             i, flow_offered[i], flow_delivered[i], flow_dropped[i], flow_resent[i], flow_delivered[i] / time);
+      if (flow_ACKed[i] > 0)
+        printf(", average ACK time %f", flow_ACK_delay[i] / flow_ACKed[i]);
+      printf("\n");
+      sum += flow_delivered[i];
+      sumsq += (double)flow_delivered[i] * flow_delivered[i];
+    }
+    /* Jain's index: 1 when every flow gets the same throughput, 1/NFLOWS when one gets it all */
+    if (sumsq > 0)
+      printf("Jain's fairness index over the flows' throughput:  %f \n", sum * sum / (NFLOWS * sumsq));
+  }
+  j = 1;
+  if (FILEMODE && !filereport())
+    j = 0;
+  if (msgstate != NULL && !verifyreport())
+    j = 0;
+  return j ? EXIT_SUCCESS : EXIT_FAILURE;
+}
\ No newline at end of file
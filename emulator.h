@@ -1,3 +1,10 @@
+#ifndef NFLOWS
+#define NFLOWS 1   /* independent flows sharing the channel, each with its own protocol state */
+#endif
+#ifndef NPATHS
+#define NPATHS 1   /* channels joining A and B, the sender choosing one for each packet */
+#endif
+
 extern int TRACE;
 
 /* statistics updated by GBN */
@@ -6,6 +13,35 @@ extern int packets_resent;       /* count of the number of packets resent  */
 extern int new_ACKs;      /* count of the number of acks correctly received */
 extern int packets_received;  /* count of the packets received by receiver */
 extern int window_full; /* count of the number of messages dropped due to full window */
+extern int packets_ACKed;  /* count of the packets A has seen acknowledged */
+extern double total_ACK_delay; /* sum of the times from first sending a packet to its ACK */
+extern int ACKs_piggybacked; /* count of ACKs carried on data packets rather than sent alone */
+extern int messages_queued;  /* count of messages put in the sender's send queue */
+extern int queue_full;       /* count of messages refused while the send queue was over its high watermark */
+extern int queue_blocked;    /* count of times the send queue reached its high watermark */
+extern int max_queue_depth;  /* the most messages ever held in a send queue */
+extern double total_queue_depth; /* sum of the send queue depths seen by arriving messages */
+extern double total_queue_delay; /* sum of the times messages waited in the send queue */
+extern int NAKs_sent;        /* count of NAKs sent by the receiver on seeing a gap */
+extern int NAK_resends;      /* count of packets resent because of a NAK rather than a timeout */
+extern int packets_packed;   /* count of data packets built with packing on */
+extern int messages_packed;  /* count of messages carried in those packets */
+extern int hol_held;         /* count of packets held in a reorder buffer for an earlier one */
+extern double hol_delay;     /* sum of the times they were held */
+
+/* per flow statistics, updated by GBN */
+extern int flow_offered[NFLOWS];   /* count of messages layer 5 gave the flow to send */
+extern int flow_delivered[NFLOWS]; /* count of the flow's messages delivered to layer 5 */
+extern int flow_dropped[NFLOWS];   /* count of the flow's messages dropped at the sender */
+extern int flow_resent[NFLOWS];    /* count of the flow's packets resent */
+extern int flow_ACKed[NFLOWS];     /* count of the flow's packets seen acknowledged */
+extern double flow_ACK_delay[NFLOWS]; /* sum of the flow's times from first sending a packet to its ACK */
+
+/* statistics updated by the FEC layer */
+extern int fec_data_sent;    /* count of data packets sent with FEC on */
+extern int parity_sent;      /* count of parity packets sent */
+extern int fec_recovered;    /* count of data packets rebuilt from parity, without a resend */
+extern double fec_time_saved; /* estimated time saved, one retransmission timeout per rebuilt packet */
 
 #define   A    0
 #define   B    1
@@ -15,8 +51,11 @@ extern int window_full; /* count of the number of messages dropped due to full w
 /* to layer 5 via the students transport level protocol entities.         */
 struct msg {
   char data[20];
+  int flow;        /* the flow the message belongs to, 0 to NFLOWS-1 */
 };
 
+#define MTU 80   /* the most payload bytes a packet can carry, room for MTU/20 messages */
+
 /* a packet is the data unit passed from layer 4 (students code) to layer */
 /* 3 (teachers code).  Note the pre-defined packet structure, which all   */
 /* students must follow. */
@@ -24,17 +63,48 @@ struct pkt {
   int seqnum;
   int acknum;
   int checksum;
-  char payload[20];
+  char payload[MTU];
+  int fec;         /* FEC block and position, see below */
+  int nmsgs;       /* messages packed one after another in the payload, 0 for ACKs */
+  int flow;        /* the flow the packet belongs to */
+  int path;        /* the path the sender chose for it, 0 to NPATHS-1; not on the wire */
+  int resent;      /* 1 if it was sent before, for the emulator's byte counts; not on the wire */
 };
 
+#define HEADERBYTES 24  /* bytes of a packet's header: the six int fields */
+
+#define FECMAXK 8       /* the most data packets in an FEC block */
+#define FECMAXM 4       /* the most parity packets sent for an FEC block */
+
+/* the fec header field of a packet: -1 for packets outside any block,
+   otherwise the block number, k and the packet's position in the block.
+   A data packet has k 0 and is at 0..; parity has the number of data
+   packets in the block as k and is at k.., so the receiver can rebuild a
+   data packet's field exactly, and the protocol's checksum can cover it */
+#define FECFIELD(block, k, pos) (((block) * (FECMAXK + 1) + (k)) * (FECMAXK + FECMAXM) + (pos))
+#define FECFIELDPOS(fec)        ((fec) % (FECMAXK + FECMAXM))
+#define FECFIELDK(fec)          (((fec) / (FECMAXK + FECMAXM)) % (FECMAXK + 1))
+#define FECFIELDBLOCK(fec)      ((fec) / (FECMAXK + FECMAXM) / (FECMAXK + 1))
+#define FECPARITY(fec)          ((fec) >= 0 && FECFIELDK(fec) > 0)
+
 /* send to A or B (int), packet to send */
 extern void tolayer3(int, struct pkt);  
 
+/* send to A or B (int), array of packets to send, number of packets */
+extern void tolayer3_batch(int, struct pkt[], int);
+
 /* deliver to A or B (int), data to deliver */
 extern void tolayer5(int, char[20]); 
 
 /* start timer at A or B (int), increment */
 extern void starttimer(int, double);       
 
+/* start timer at A or B (int), increment, and how late it may go off
+   (double), so that an event already set for it can be kept */
+extern void starttimer_slack(int, double, double);
+
 /* stop timer at A or B (int) */
 extern void stoptimer(int);               
+
+/* current simulation time */
+extern float gettime(void);
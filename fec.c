@@ -0,0 +1,507 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include "emulator.h"
+#include "fec.h"
+
+/* ******************************************************************
+   Forward error correction for the GBN and SR protocols.  GBN refuses it
+   unless its receiver keeps packets that arrive ahead of a gap
+   (REORDERBUF), since otherwise a rebuilt packet saves no resends.
+   Parity packets take up the channel as any packet does, so FEC only
+   pays for itself while the channel has room to spare.
+
+   Every data packet sent is also kept in the current block.  Once k are
+   in the block the parity packets for it are sent, and so they are once
+   FECFLUSH of a timeout has passed since its first, over the data packets
+   it has, so that parity for a block that fills slowly arrives before the
+   protocol gives up on a packet lost from it and resends it.  A parity
+   packet has the same layout as a data packet, and each of its header
+   fields and payload bytes is a combination of the same field or byte of
+   the block's data packets:
+   - XOR mode: one parity packet, the XOR of the data packets.  Rebuilds
+   one missing packet per block.
+   - Reed-Solomon mode: m parity packets, each a sum over GF(2^8) of the
+   data packets weighted by a row of a Cauchy matrix.  Any m missing
+   packets of a block can be rebuilt from any m parity packets.
+
+   With FECADAPT set the sender keeps an estimate of the loss rate, from
+   how many of the packets it is given are retransmissions, and picks the
+   redundancy of each block from it: the block size k in XOR mode, the
+   number of parity packets m in Reed-Solomon mode.  It picks the least
+   redundancy that leaves a block unrecoverable with probability at most
+   FECTARGET.
+**********************************************************************/
+
+#define FECMODE 0       /* 0 = no FEC, 1 = XOR parity, 2 = Reed-Solomon parity */
+#define FECK 4          /* data packets per block, at most FECMAXK */
+#define FECM 2          /* Reed-Solomon parity packets per block, at most FECMAXM */
+#define FECADAPT 0      /* 1 = choose the redundancy of each block from the loss rate */
+#define FECTARGET 0.01  /* with FECADAPT, the chance of losing a block worth designing for */
+#define FECGAIN 0.05    /* with FECADAPT, the weight of each packet in the loss estimate */
+#define FECFLUSH 0.25   /* a part-full block gets its parity this fraction of a timeout after its first packet */
+#define FECBLOCKS 32    /* blocks the receiver keeps packets for, the most recent ones */
+#define FECBLOCKWRAP 100000 /* block numbers wrap here, keeping the fec field in range */
+#define NOTINUSE (-1)   /* the fec field of a packet that is not in a block */
+
+#define FECBYTES (20 + MTU) /* bytes of a packet covered by parity: 5 header ints and payload */
+
+/********* GF(2^8) arithmetic, for Reed-Solomon ************/
+
+static int gfexp[512];  /* powers of the generator, doubled up to save a modulo */
+static int gflog[256];  /* discrete logarithms, gflog[0] unused */
+
+static void gfinit(void)
+{
+  int i;
+  int x = 1;
+
+  for (i = 0; i < 255; i++) {
+    gfexp[i] = x;
+    gflog[x] = i;
+    x <<= 1;
+    if (x & 0x100)
+      x ^= 0x11d;   /* x^8 + x^4 + x^3 + x^2 + 1 */
+  }
+  for (i = 255; i < 512; i++)
+    gfexp[i] = gfexp[i - 255];
+}
+
+static int gfmul(int a, int b)
+{
+  if (a == 0 || b == 0)
+    return 0;
+  return gfexp[gflog[a] + gflog[b]];
+}
+
+static int gfinv(int a)
+{
+  return gfexp[255 - gflog[a]];
+}
+
+/* weight of data packet i in parity packet j */
+static int coefficient(int j, int i)
+{
+  if (FECMODE == 1)
+    return 1;
+  /* Cauchy matrix 1 / (x_j + y_i), x_j = FECMAXK + j and y_i = i never meet,
+     and every square submatrix of a Cauchy matrix is invertible */
+  return gfinv((FECMAXK + j) ^ i);
+}
+
+/* a packet as the bytes parity is computed over, and back */
+static void tobytes(struct pkt packet, unsigned char bytes[FECBYTES])
+{
+  memcpy(bytes, &packet.seqnum, 4);
+  memcpy(bytes + 4, &packet.acknum, 4);
+  memcpy(bytes + 8, &packet.checksum, 4);
+  memcpy(bytes + 12, &packet.nmsgs, 4);
+  memcpy(bytes + 16, &packet.flow, 4);
+  memcpy(bytes + 20, packet.payload, MTU);
+}
+
+static void frombytes(unsigned char bytes[FECBYTES], struct pkt *packet)
+{
+  memcpy(&packet->seqnum, bytes, 4);
+  memcpy(&packet->acknum, bytes + 4, 4);
+  memcpy(&packet->checksum, bytes + 8, 4);
+  memcpy(&packet->nmsgs, bytes + 12, 4);
+  memcpy(&packet->flow, bytes + 16, 4);
+  memcpy(packet->payload, bytes + 20, MTU);
+  packet->path = 0;
+  packet->resent = 0;
+}
+
+
+/********* Sender variables and functions ************/
+
+struct fecsender {
+  unsigned char block[FECMAXK][FECBYTES];  /* data packets of the current block */
+  int count;       /* data packets in the current block so far */
+  int blocknum;    /* number of the current block */
+  int k, m;        /* size of the current block, and parity packets it gets */
+  double loss;     /* estimated fraction of packets lost */
+  float deadline;  /* when a part-full block gets its parity, NOTINUSE while the block is empty */
+};
+
+static struct fecsender fs[2];
+static float fectimeout[2];      /* the protocol's retransmission timeout */
+
+/* chance that more than m of n packets are lost, each with probability p */
+static double blockloss(int n, int m, double p)
+{
+  double term = 1.0;   /* probability of exactly i losses, starting at i = 0 */
+  double sum = 0.0;
+  int i;
+
+  for (i = 0; i < n; i++)
+    term *= 1.0 - p;
+  for (i = 0; i <= m; i++) {
+    sum += term;
+    if (p >= 1.0)
+      break;
+    term = term * (n - i) / (i + 1) * p / (1.0 - p);
+  }
+  return 1.0 - sum;
+}
+
+/* choose k and m for the block about to start */
+static void chooseredundancy(int AorB)
+{
+  struct fecsender *s = &fs[AorB];
+
+  s->k = FECK;
+  s->m = (FECMODE == 1) ? 1 : FECM;
+  if (!FECADAPT)
+    return;
+
+  if (FECMODE == 1) {
+    /* one parity packet, so the block is as long as the loss rate allows */
+    for (s->k = FECMAXK; s->k > 1; s->k--)
+      if (blockloss(s->k + 1, 1, s->loss) <= FECTARGET)
+        break;
+  }
+  else {
+    for (s->m = 1; s->m < FECMAXM; s->m++)
+      if (blockloss(s->k + s->m, s->m, s->loss) <= FECTARGET)
+        break;
+  }
+}
+
+/* compute and send the parity packets of the current block, over the
+   data packets in it so far, and start the next block.  A block closed
+   early gets no more parity packets than data packets, and its parity
+   tells the receiver how many data packets it has */
+static void closeblock(int AorB)
+{
+  struct fecsender *s = &fs[AorB];
+  struct pkt parity[FECMAXM];
+  unsigned char bytes[FECBYTES];
+  int m = s->count < s->m ? s->count : s->m;
+  int i, j, b, c;
+
+  for (j = 0; j < m; j++) {
+    memset(bytes, 0, FECBYTES);
+    for (i = 0; i < s->count; i++) {
+      c = coefficient(j, i);
+      for (b = 0; b < FECBYTES; b++)
+        bytes[b] ^= gfmul(c, s->block[i][b]);
+    }
+    frombytes(bytes, &parity[j]);
+    parity[j].fec = FECFIELD(s->blocknum, s->count, s->count + j);
+    parity[j].path = j % NPATHS;  /* spread over the paths, so one path's losses do not take it all */
+  }
+  if (TRACE > 0)
+    printf("          FEC: sending %d parity packets for block %d\n", m, s->blocknum);
+  tolayer3_batch(AorB, parity, m);
+  parity_sent += m;
+
+  s->blocknum = (s->blocknum + 1) % FECBLOCKWRAP;
+  s->count = 0;
+  s->deadline = NOTINUSE;
+  chooseredundancy(AorB);
+}
+
+void fec_send(int AorB, struct pkt packets[], int count, bool resend)
+{
+  struct fecsender *s = &fs[AorB];
+  int i, first;
+
+  for (i = 0; i < count; i++)
+    packets[i].resent = resend;
+  if (FECMODE == 0) {
+    tolayer3_batch(AorB, packets, count);
+    return;
+  }
+
+  /* data packets join the current block, anything else goes as it is */
+  first = 0;
+  for (i = 0; i < count; i++) {
+    if (packets[i].seqnum < 0)
+      continue;
+    s->loss = (1.0 - FECGAIN) * s->loss + (resend ? FECGAIN : 0.0);
+    fec_data_sent++;
+    if (s->count == 0)
+      s->deadline = gettime() + FECFLUSH * fectimeout[AorB];
+    packets[i].fec = FECFIELD(s->blocknum, 0, s->count);
+    packets[i].checksum = ComputeChecksum(packets[i]);
+    tobytes(packets[i], s->block[s->count]);
+    s->count++;
+
+    if (s->count == s->k) {
+      /* the block is complete: send its data, then its parity */
+      tolayer3_batch(AorB, packets + first, i + 1 - first);
+      first = i + 1;
+      closeblock(AorB);
+    }
+  }
+  if (first < count)
+    tolayer3_batch(AorB, packets + first, count - first);
+}
+
+float fec_deadline(int AorB)
+{
+  return fs[AorB].deadline;
+}
+
+void fec_flush(int AorB)
+{
+  if (fs[AorB].count == 0)
+    return;
+  if (TRACE > 0)
+    printf("          FEC: block %d is not full in time, close it at %d packets\n",
+           fs[AorB].blocknum, fs[AorB].count);
+  closeblock(AorB);
+}
+
+
+/********* Receiver variables and functions ************/
+
+struct fecblock {
+  int blocknum;                  /* block held, NOTINUSE if none */
+  int k;                         /* data packets in the block, 0 until parity says */
+  bool have[FECMAXK + FECMAXM];  /* which have arrived intact: data, then parity from FECMAXK */
+  unsigned char bytes[FECMAXK + FECMAXM][FECBYTES];
+  bool done;                     /* all data packets have arrived or been rebuilt */
+  bool saved[FECMAXK];           /* which were rebuilt and counted as saving a resend */
+  int seqnum[FECMAXK], flow[FECMAXK]; /* of the data packets arrived or rebuilt */
+  float time[FECMAXK];           /* when each arrived or was rebuilt */
+};
+
+static struct fecblock fr[2][FECBLOCKS];
+
+/* A rebuilt packet saves a resend only if no other copy of it reaches the
+   receiver: one that came before means it was not needed, and one that
+   comes after means it was resent all the same.  The blocks held are
+   searched for copies.  Sequence numbers are reused, so only a copy that
+   arrives within a timeout of the rebuild is taken to be one */
+
+/* whether a copy of the flow's data packet seqnum has arrived intact
+   within a timeout */
+static bool arrived(int AorB, int flow, int seqnum)
+{
+  struct fecblock *blk;
+  int b, i;
+
+  for (b = 0; b < FECBLOCKS; b++) {
+    blk = &fr[AorB][b];
+    if (blk->blocknum != NOTINUSE)
+      for (i = 0; i < FECMAXK; i++)
+        if (blk->have[i] && blk->seqnum[i] == seqnum && blk->flow[i] == flow
+            && gettime() - blk->time[i] <= fectimeout[AorB])
+          return true;
+  }
+  return false;
+}
+
+/* a copy of the flow's data packet seqnum has arrived intact: if it was
+   rebuilt within a timeout before, that did not save a resend after all */
+static void resent(int AorB, int flow, int seqnum)
+{
+  struct fecblock *blk;
+  int b, i;
+
+  for (b = 0; b < FECBLOCKS; b++) {
+    blk = &fr[AorB][b];
+    if (blk->blocknum != NOTINUSE)
+      for (i = 0; i < FECMAXK; i++)
+        if (blk->saved[i] && blk->seqnum[i] == seqnum && blk->flow[i] == flow
+            && gettime() - blk->time[i] <= fectimeout[AorB]) {
+          blk->saved[i] = false;
+          fec_recovered--;
+          fec_time_saved -= fectimeout[AorB];
+        }
+  }
+}
+
+/* rebuild the missing data packets of a block from its parity packets.
+   Returns how many were rebuilt into out, and where each goes in the block
+   in pos */
+static int rebuild(struct fecblock *blk, struct pkt out[], int pos[])
+{
+  int missing[FECMAXK], rows[FECMAXM];
+  int matrix[FECMAXM][FECMAXM];
+  unsigned char rhs[FECMAXM][FECBYTES];
+  int nmissing = 0, nrows = 0;
+  int i, j, r, b, c, t, pivot, inv;
+  int n = 0;
+  struct pkt packet;
+
+  for (i = 0; i < blk->k; i++)
+    if (!blk->have[i])
+      missing[nmissing++] = i;
+  for (j = 0; j < FECMAXM && nrows < nmissing; j++)
+    if (blk->have[FECMAXK + j])
+      rows[nrows++] = j;
+  if (nmissing == 0 || nrows < nmissing)
+    return 0;
+
+  /* each parity row, less the data packets that did arrive, is a sum of
+     the missing packets: solve those nmissing equations */
+  for (r = 0; r < nmissing; r++) {
+    memcpy(rhs[r], blk->bytes[FECMAXK + rows[r]], FECBYTES);
+    for (i = 0; i < blk->k; i++)
+      if (blk->have[i]) {
+        c = coefficient(rows[r], i);
+        for (b = 0; b < FECBYTES; b++)
+          rhs[r][b] ^= gfmul(c, blk->bytes[i][b]);
+      }
+    for (c = 0; c < nmissing; c++)
+      matrix[r][c] = coefficient(rows[r], missing[c]);
+  }
+
+  /* Gauss-Jordan elimination over GF(2^8) */
+  for (c = 0; c < nmissing; c++) {
+    for (pivot = c; pivot < nmissing && matrix[pivot][c] == 0; pivot++)
+      ;
+    if (pivot == nmissing)
+      return 0;
+    if (pivot != c) {
+      unsigned char tmp[FECBYTES];
+      for (t = 0; t < nmissing; t++) {
+        i = matrix[c][t]; matrix[c][t] = matrix[pivot][t]; matrix[pivot][t] = i;
+      }
+      memcpy(tmp, rhs[c], FECBYTES);
+      memcpy(rhs[c], rhs[pivot], FECBYTES);
+      memcpy(rhs[pivot], tmp, FECBYTES);
+    }
+    inv = gfinv(matrix[c][c]);
+    for (t = 0; t < nmissing; t++)
+      matrix[c][t] = gfmul(inv, matrix[c][t]);
+    for (b = 0; b < FECBYTES; b++)
+      rhs[c][b] = gfmul(inv, rhs[c][b]);
+    for (r = 0; r < nmissing; r++)
+      if (r != c && matrix[r][c] != 0) {
+        int f = matrix[r][c];
+        for (t = 0; t < nmissing; t++)
+          matrix[r][t] ^= gfmul(f, matrix[c][t]);
+        for (b = 0; b < FECBYTES; b++)
+          rhs[r][b] ^= gfmul(f, rhs[c][b]);
+      }
+  }
+
+  for (r = 0; r < nmissing; r++) {
+    frombytes(rhs[r], &packet);
+    packet.fec = FECFIELD(blk->blocknum, 0, missing[r]);
+    /* a corrupted parity packet rebuilds garbage, which the checksum catches */
+    if (IsCorrupted(packet))
+      continue;
+    pos[n] = missing[r];
+    out[n++] = packet;
+  }
+  return n;
+}
+
+int fec_receive(int AorB, struct pkt packet, struct pkt out[])
+{
+  struct fecblock *blk;
+  int rebuilt[FECMAXK];
+  int blocknum, pos, k, i, j;
+  bool parity;
+  int n = 0;
+  int have = 0;
+
+  /* a packet in no block goes straight up.  The checksum covers a data
+     packet's fec field but parity has none of its own, and a corrupted
+     packet may have any value in it, so what it says is checked before use */
+  if (FECMODE == 0 || packet.fec < 0) {
+    out[0] = packet;
+    return 1;
+  }
+
+  pos = FECFIELDPOS(packet.fec);
+  k = FECFIELDK(packet.fec);
+  blocknum = FECFIELDBLOCK(packet.fec);
+  parity = FECPARITY(packet.fec);
+
+  /* data packets always go straight up, whole or corrupted */
+  if (!parity)
+    out[n++] = packet;
+
+  if (parity ? k > FECMAXK || pos < k || pos >= k + FECMAXM : pos >= FECMAXK)
+    return n;
+  if (!parity && IsCorrupted(packet))
+    return n;
+
+  if (!parity)
+    resent(AorB, packet.flow, packet.seqnum);
+
+  /* file the packet with its block, making room by forgetting the oldest.
+     Only parity gives the number of data packets in the block, which is
+     fewer than were planned for it if it was closed early */
+  blk = &fr[AorB][blocknum % FECBLOCKS];
+  if (blk->blocknum != blocknum) {
+    blk->blocknum = blocknum;
+    blk->k = 0;
+    blk->done = false;
+    for (i = 0; i < FECMAXK + FECMAXM; i++)
+      blk->have[i] = false;
+    for (i = 0; i < FECMAXK; i++)
+      blk->saved[i] = false;
+  }
+  if (parity && blk->k == 0)
+    blk->k = k;
+  if (parity)
+    pos = FECMAXK + pos - k;
+  if (blk->done || (parity ? k != blk->k : blk->k > 0 && pos >= blk->k) || blk->have[pos])
+    return n;
+  blk->have[pos] = true;
+  tobytes(packet, blk->bytes[pos]);
+  if (!parity) {
+    blk->seqnum[pos] = packet.seqnum;
+    blk->flow[pos] = packet.flow;
+    blk->time[pos] = gettime();
+  }
+  if (blk->k == 0)
+    return n;
+
+  for (i = 0; i < blk->k; i++)
+    if (blk->have[i])
+      have++;
+  if (have == blk->k) {
+    blk->done = true;
+    return n;
+  }
+
+  /* data packets are missing: rebuild them if enough parity is here */
+  i = rebuild(blk, out + n, rebuilt);
+  if (i > 0) {
+    if (TRACE > 0)
+      printf("          FEC: rebuilt %d packets of block %d\n", i, blocknum);
+    blk->done = true;
+    for (j = 0; j < i; j++) {
+      pos = rebuilt[j];
+      blk->seqnum[pos] = out[n + j].seqnum;
+      blk->flow[pos] = out[n + j].flow;
+      blk->time[pos] = gettime();
+      if (!arrived(AorB, out[n + j].flow, out[n + j].seqnum)) {
+        blk->saved[pos] = true;
+        fec_recovered++;
+        fec_time_saved += fectimeout[AorB];
+      }
+    }
+  }
+  return n + i;
+}
+
+void fec_init(int AorB, float timeout)
+{
+  int i;
+
+  gfinit();
+  fs[AorB].count = 0;
+  fs[AorB].blocknum = 0;
+  fs[AorB].loss = 0.0;
+  fs[AorB].deadline = NOTINUSE;
+  chooseredundancy(AorB);
+
+  for (i = 0; i < FECBLOCKS; i++)
+    fr[AorB][i].blocknum = NOTINUSE;
+  fectimeout[AorB] = timeout;
+}
+
+bool fec_on(void)
+{
+  return FECMODE != 0;
+}
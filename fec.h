@@ -0,0 +1,47 @@
+/* ******************************************************************
+   Forward error correction layer.  Sits between a protocol and layer 3:
+   the protocol hands its packets to fec_send() instead of tolayer3(), and
+   passes every packet that arrives through fec_receive() before acting on
+   it.  Data packets (seqnum >= 0) are grouped into blocks of k, fewer if
+   a block does not fill in time, and after each block m parity packets
+   are sent, from which the receiver can rebuild up to m lost or corrupted
+   data packets of the block without waiting for a retransmission.
+
+   Build with the protocol and emulator:  gcc emulator.c channel.c wire.c stats.c arq.c gbn.c fec.c -lm
+**********************************************************************/
+
+/* the block size limits and the layout of the fec header field are in
+   emulator.h, beside struct pkt */
+
+/* the protocol's checksum, and its test, used to keep corrupted packets
+   out of blocks.  The checksum covers the fec field, so the layer sums it
+   again once it has put a data packet in a block */
+extern int ComputeChecksum(struct pkt);
+extern bool IsCorrupted(struct pkt);
+
+/* set up the FEC layer of A or B (int); timeout (float) is the protocol's
+   retransmission timeout, the time a rebuilt packet saves at least */
+extern void fec_init(int, float);
+
+/* whether FEC is on, FECMODE being set.  Its state is kept per entity, so
+   a server of many sessions refuses to run with it */
+extern bool fec_on(void);
+
+/* send from A or B (int) packets (struct pkt[]), how many (int), and
+   whether they are retransmissions (bool), which is how the layer
+   learns the loss rate when it adapts the redundancy.  The packets come
+   with fec NOTINUSE and their checksum computed */
+extern void fec_send(int, struct pkt[], int, bool);
+
+/* a packet (struct pkt) has arrived at A or B (int).  Fills in the packets
+   (struct pkt[], room for FECMAXK + 1) the protocol should act on, in
+   order, and returns how many there are */
+extern int fec_receive(int, struct pkt, struct pkt[]);
+
+/* when the part-full block of A or B (int) is to get its parity, or
+   NOTINUSE if the block is empty.  The protocol keeps its timer set for
+   it, and calls fec_flush() once it has passed */
+extern float fec_deadline(int);
+
+/* send the parity of A or B's (int) part-full block now */
+extern void fec_flush(int);
@@ -3,6 +3,8 @@
 #include <stdbool.h>
 #include "emulator.h"
 #include "gbn.h"
+#include "fec.h"
+#include "arq.h"
 
 /* ******************************************************************
    Go Back N protocol.  Adapted from J.F.Kurose
@@ -20,256 +22,456 @@
    - removed bidirectional GBN code and other code not used by prac. 
    - fixed C style to adhere to current programming style
    - added GBN implementation
+   - restored bidirectional transfer, with ACKs piggybacked on data
 **********************************************************************/
 
-#define RTT  16.0       /* round trip time.  MUST BE SET TO 16.0 when submitting assignment */
 #define WINDOWSIZE 6    /* the maximum number of buffered unacked packet */
-#define SEQSPACE 7      /* the min sequence space for GBN must be at least windowsize + 1 */
-#define NOTINUSE (-1)   /* used to fill header fields that are not being used */
-
-/* generic procedure to compute the checksum of a packet.  Used by both sender and receiver  
-   the simulator will overwrite part of your packet with 'z's.  It will not overwrite your 
-   original checksum.  This procedure must generate a different checksum to the original if
-   the packet is corrupted.
-*/
-int ComputeChecksum(struct pkt packet)
+#define SEQSPACE (HOLDAHEAD ? 2 * WINDOWSIZE : 7) /* at least windowsize + 1 for GBN, 2 * windowsize if B buffers as SR does */
+#define REORDERBUF 0    /* 1 = B buffers packets that arrive ahead of a gap, 0 = discards them */
+#define HOLDAHEAD (REORDERBUF || NPATHS > 1) /* whether B buffers them, which it always does over several paths */
+
+/********* Sender variables and functions ************/
+
+struct sender {
+  struct pkt buffer[WINDOWSIZE];  /* array for storing packets waiting for ACK */
+  float sendtime[WINDOWSIZE];     /* time each packet in the window was first sent */
+  int windowfirst, windowlast;    /* array indexes of the first/last packet awaiting ACK */
+  int windowcount;                /* the number of packets currently awaiting an ACK */
+  int nextseqnum;                 /* the next sequence number to be used by the sender */
+  bool resent[WINDOWSIZE];        /* sent more than once, so its ACK gives no RTT sample */
+};
+
+/********* Receiver variables ************/
+
+struct receiver {
+  int expectedseqnum;  /* the sequence number expected next by the receiver */
+  int unacked;         /* in-order packets received but not yet ACKed (held back ACKs) */
+  float naktime[SEQSPACE]; /* when each sequence number was last NAKed, NOTINUSE if never */
+  int path;            /* the path the last data packet came in on, which ACKs go back on */
+  struct pkt held[SEQSPACE]; /* with HOLDAHEAD, packets that arrived ahead of a gap */
+  bool isheld[SEQSPACE];     /* whether there is a packet in held for the sequence number */
+  float heldtime[SEQSPACE];  /* when it arrived */
+};
+
+static struct sender snd[NFLOWS][2];
+static struct receiver rcv[NFLOWS][2];
+
+const int seqspace = SEQSPACE;
+const int receiversize = sizeof(struct receiver);
+
+/* the cumulative ACK number for everything received in order so far */
+static int lastinorder(struct receiver *r)
 {
-  int checksum = 0;
-  int i;
+  if (r->expectedseqnum == 0)
+    return SEQSPACE - 1;
+  else
+    return r->expectedseqnum - 1;
+}
 
-  checksum = packet.seqnum;
-  checksum += packet.acknum;
-  for ( i=0; i<20; i++ ) 
-    checksum += (int)(packet.payload[i]);
+/* the ACK number to carry on an outgoing data packet.  If an ACK is being
+   held back it goes out on the packet, otherwise there is nothing to carry */
+static int piggyback(int AorB, int flow)
+{
+  if (rcv[flow][AorB].unacked == 0)
+    return NOTINUSE;
 
-  return checksum;
+  rcv[flow][AorB].unacked = 0;
+  ackdeadline[flow][AorB] = NOTINUSE;
+  ACKs_piggybacked++;
+  return lastinorder(&rcv[flow][AorB]);
 }
 
-bool IsCorrupted(struct pkt packet)
+/* send a pure cumulative ACK for everything the flow's receiver r has
+   received so far in order */
+static void sendACK(int AorB, int flow, struct receiver *r)
 {
-  if (packet.checksum == ComputeChecksum(packet))
-    return (false);
-  else
-    return (true);
-}
+  struct pkt sendpkt;
+  int i;
 
+  /* this ACK covers any held back ACK */
+  r->unacked = 0;
+  ackdeadline[flow][AorB] = NOTINUSE;
+
+  /* create packet, no data so no sequence number */
+  sendpkt.acknum = lastinorder(r);
+  sendpkt.seqnum = NOTINUSE;
+  sendpkt.nmsgs = 0;
+  sendpkt.flow = flow;
+  sendpkt.fec = NOTINUSE;
+  sendpkt.path = r->path;
+    
+  /* we don't have any data to send.  fill payload with 0's */
+  for ( i=0; i<MTU ; i++ ) 
+    sendpkt.payload[i] = '0';  
 
-/********* Sender (A) variables and functions ************/
+  /* computer checksum */
+  sendpkt.checksum = ComputeChecksum(sendpkt); 
+
+  /* send out packet */
+  fec_send(AorB, &sendpkt, 1, false);
+}
 
-static struct pkt buffer[WINDOWSIZE];  /* array for storing packets waiting for ACK */
-static int windowfirst, windowlast;    /* array indexes of the first/last packet awaiting ACK */
-static int windowcount;                /* the number of packets currently awaiting an ACK */
-static int A_nextseqnum;               /* the next sequence number to be used by the sender */
+/* true if the send window has room for another packet */
+bool windowopen(int AorB, int flow)
+{
+  return snd[flow][AorB].windowcount < WINDOWSIZE;
+}
 
-/* called from layer 5 (application layer), passed the message to be sent to other side */
-void A_output(struct msg message)
+/* the number of packets awaiting an ACK */
+int inflight(int AorB, int flow)
 {
+  return snd[flow][AorB].windowcount;
+}
+
+/* put n messages in a packet and send it; the window must have room for it */
+void sendmessage(int AorB, int flow, struct msg messages[], int n)
+{
+  struct sender *s = &snd[flow][AorB];
   struct pkt sendpkt;
   int i;
 
-  /* if not blocked waiting on ACK */
-  if ( windowcount < WINDOWSIZE) {
-    if (TRACE > 1)
-      printf("----A: New message arrives, send window is not full, send new messge to layer3!\n");
-
-    /* create packet */
-    sendpkt.seqnum = A_nextseqnum;
-    sendpkt.acknum = NOTINUSE;
-    for ( i=0; i<20 ; i++ ) 
-      sendpkt.payload[i] = message.data[i];
-    sendpkt.checksum = ComputeChecksum(sendpkt); 
-
-    /* put packet in window buffer */
-    /* windowlast will always be 0 for alternating bit; but not for GoBackN */
-    windowlast = (windowlast + 1) % WINDOWSIZE; 
-    buffer[windowlast] = sendpkt;
-    windowcount++;
-
-    /* send out packet */
-    if (TRACE > 0)
-      printf("Sending packet %d to layer 3\n", sendpkt.seqnum);
-    tolayer3 (A, sendpkt);
+  /* create packet */
+  sendpkt.seqnum = s->nextseqnum;
+  sendpkt.acknum = NOTINUSE;
+  sendpkt.nmsgs = n;
+  sendpkt.flow = flow;
+  sendpkt.fec = NOTINUSE;
+  sendpkt.path = choosepath(AorB);
+  for ( i=0; i<MTU ; i++ ) 
+    if (i < 20 * n)
+      sendpkt.payload[i] = messages[i / 20].data[i % 20];
+    else
+      sendpkt.payload[i] = '0';
+  sendpkt.checksum = ComputeChecksum(sendpkt); 
 
-    /* start timer if first packet in window */
-    if (windowcount == 1)
-      starttimer(A,RTT);
+  /* put packet in window buffer */
+  /* windowlast will always be 0 for alternating bit; but not for GoBackN */
+  s->windowlast = (s->windowlast + 1) % WINDOWSIZE; 
+  s->buffer[s->windowlast] = sendpkt;
+  s->sendtime[s->windowlast] = gettime();
+  s->resent[s->windowlast] = false;
+  s->windowcount++;
 
-    /* get next sequence number, wrap back to 0 */
-    A_nextseqnum = (A_nextseqnum + 1) % SEQSPACE;  
-  }
-  /* if blocked,  window is full */
-  else {
-    if (TRACE > 0)
-      printf("----A: New message arrives, send window is full\n");
-    window_full++;
-  }
+  /* send out packet, with any held back ACK riding on it */
+  sendpkt.acknum = piggyback(AorB, flow);
+  sendpkt.checksum = ComputeChecksum(sendpkt); 
+  if (TRACE > 0)
+    printf("Sending packet %d to layer 3\n", sendpkt.seqnum);
+  fec_send(AorB, &sendpkt, 1, false);
+
+  /* start timer if first packet in window */
+  if (s->windowcount == 1)
+    rtodeadline[flow][AorB] = gettime() + RTT;
+
+  /* get next sequence number, wrap back to 0 */
+  s->nextseqnum = (s->nextseqnum + 1) % SEQSPACE;  
 }
 
 
-/* called from layer 3, when a packet arrives for layer 4 
-   In this practical this will always be an ACK as B never sends data.
-*/
-void A_input(struct pkt packet)
+/* how many packets an ACK is for, counting from the start of the window:
+   0 if it is a duplicate */
+static int ackreach(int AorB, int flow, int acknum)
+{
+  struct sender *s = &snd[flow][AorB];
+  int seqfirst, seqlast;
+
+  if (s->windowcount == 0)
+    return 0;
+  seqfirst = s->buffer[s->windowfirst].seqnum;
+  seqlast = s->buffer[s->windowlast].seqnum;
+  /* check case when seqnum has and hasn't wrapped */
+  if (((seqfirst <= seqlast) && (acknum >= seqfirst && acknum <= seqlast)) ||
+      ((seqfirst > seqlast) && (acknum >= seqfirst || acknum <= seqlast))) {
+    /* cumulative acknowledgement - determine how many packets are ACKed */
+    if (acknum >= seqfirst)
+      return acknum + 1 - seqfirst;
+    return SEQSPACE - seqfirst + acknum;
+  }
+  return 0;
+}
+
+/* called when an uncorrupted ACK (pure or piggybacked) arrives at the sender */
+static void ackinput(int AorB, int flow, int acknum)
 {
-  int ackcount = 0;
+  struct sender *s = &snd[flow][AorB];
+  int ackcount;
   int i;
 
-  /* if received ACK is not corrupted */ 
-  if (!IsCorrupted(packet)) {
+  if (TRACE > 0)
+    printf("----%c: uncorrupted ACK %d is received\n", entityname[AorB], acknum);
+  total_ACKs_received++;
+
+  /* check if new ACK or duplicate */
+  ackcount = ackreach(AorB, flow, acknum);
+  if (ackcount > 0) {
+    /* packet is a new ACK */
     if (TRACE > 0)
-      printf("----A: uncorrupted ACK %d is received\n",packet.acknum);
-    total_ACKs_received++;
-
-    /* check if new ACK or duplicate */
-    if (windowcount != 0) {
-          int seqfirst = buffer[windowfirst].seqnum;
-          int seqlast = buffer[windowlast].seqnum;
-          /* check case when seqnum has and hasn't wrapped */
-          if (((seqfirst <= seqlast) && (packet.acknum >= seqfirst && packet.acknum <= seqlast)) ||
-              ((seqfirst > seqlast) && (packet.acknum >= seqfirst || packet.acknum <= seqlast))) {
-
-            /* packet is a new ACK */
-            if (TRACE > 0)
-              printf("----A: ACK %d is not a duplicate\n",packet.acknum);
-            new_ACKs++;
-
-            /* cumulative acknowledgement - determine how many packets are ACKed */
-            if (packet.acknum >= seqfirst)
-              ackcount = packet.acknum + 1 - seqfirst;
-            else
-              ackcount = SEQSPACE - seqfirst + packet.acknum;
-
-	    /* slide window by the number of packets ACKed */
-            windowfirst = (windowfirst + ackcount) % WINDOWSIZE;
-
-            /* delete the acked packets from window buffer */
-            for (i=0; i<ackcount; i++)
-              windowcount--;
-
-	    /* start timer again if there are still more unacked packets in window */
-            stoptimer(A);
-            if (windowcount > 0)
-              starttimer(A, RTT);
-
-          }
-        }
-        else
-          if (TRACE > 0)
-        printf ("----A: duplicate ACK received, do nothing!\n");
+      printf("----%c: ACK %d is not a duplicate\n", entityname[AorB], acknum);
+    new_ACKs++;
+
+    /* time from first send to ACK, for each packet ACKed */
+    for (i=0; i<ackcount; i++) {
+      total_ACK_delay += gettime() - s->sendtime[(s->windowfirst + i) % WINDOWSIZE];
+      packets_ACKed++;
+      flow_ACK_delay[flow] += gettime() - s->sendtime[(s->windowfirst + i) % WINDOWSIZE];
+      flow_ACKed[flow]++;
+    }
+
+    /* the packet the ACK is for gives its path's RTT, if sent only once */
+    i = (s->windowfirst + ackcount - 1) % WINDOWSIZE;
+    if (NPATHS > 1 && !s->resent[i])
+      pathsample(AorB, s->buffer[i].path, gettime() - s->sendtime[i]);
+
+    /* slide window by the number of packets ACKed */
+    s->windowfirst = (s->windowfirst + ackcount) % WINDOWSIZE;
+
+    /* delete the acked packets from window buffer */
+    for (i=0; i<ackcount; i++)
+      s->windowcount--;
+
+    /* start timer again if there are still more unacked packets in window */
+    if (s->windowcount > 0)
+      rtodeadline[flow][AorB] = gettime() + RTT;
+    else
+      rtodeadline[flow][AorB] = NOTINUSE;
+
+    /* the window has opened, send any messages waiting for it */
+    windowslid(AorB, flow);
   }
-  else 
+  else
     if (TRACE > 0)
-      printf ("----A: corrupted ACK is received, do nothing!\n");
+      printf ("----%c: duplicate ACK received, do nothing!\n", entityname[AorB]);
 }
 
-/* called when A's timer goes off */
-void A_timerinterrupt(void)
+/* resend every packet in the window and restart the timer */
+static void gobackN(int AorB, int flow)
 {
+  struct sender *s = &snd[flow][AorB];
+  struct pkt resend[WINDOWSIZE];
+  int acknum;
   int i;
 
-  if (TRACE > 0)
-    printf("----A: time out,resend packets!\n");
-
-  for(i=0; i<windowcount; i++) {
+  acknum = piggyback(AorB, flow);
+  for(i=0; i<s->windowcount; i++) {
 
     if (TRACE > 0)
-      printf ("---A: resending packet %d\n", (buffer[(windowfirst+i) % WINDOWSIZE]).seqnum);
-
-    tolayer3(A,buffer[(windowfirst+i) % WINDOWSIZE]);
+      printf ("---%c: resending packet %d\n", entityname[AorB], (s->buffer[(s->windowfirst+i) % WINDOWSIZE]).seqnum);
+
+    resend[i] = s->buffer[(s->windowfirst+i) % WINDOWSIZE];
+    resend[i].acknum = acknum;
+    resend[i].path = choosepath(AorB);
+    s->buffer[(s->windowfirst+i) % WINDOWSIZE].path = resend[i].path;
+    s->resent[(s->windowfirst+i) % WINDOWSIZE] = true;
+    resend[i].checksum = ComputeChecksum(resend[i]);
     packets_resent++;
-    if (i==0) starttimer(A,RTT);
+    flow_resent[flow]++;
   }
-}       
-
 
+  /* go back N: hand the whole window to layer 3 as a single burst */
+  if (s->windowcount > 0) {
+    fec_send(AorB, resend, s->windowcount, true);
+    rtodeadline[flow][AorB] = gettime() + RTT;
+  }
+  else
+    rtodeadline[flow][AorB] = NOTINUSE;
+}
 
-/* the following routine will be called once (only) before any other */
-/* entity A routines are called. You can use it to do any initialization */
-void A_init(void)
+/* called when the retransmission timeout expires */
+void timeout(int AorB, int flow)
 {
-  /* initialise A's window, buffer and sequence number */
-  A_nextseqnum = 0;  /* A starts with seq num 0, do not change this */
-  windowfirst = 0;
-  windowlast = -1;   /* windowlast is where the last packet sent is stored.  
-		     new packets are placed in winlast + 1 
-		     so initially this is set to -1
-		   */
-  windowcount = 0;
+  struct sender *s = &snd[flow][AorB];
+
+  if (TRACE > 0)
+    printf("----%c: time out,resend packets!\n", entityname[AorB]);
+  if (NPATHS > 1)
+    pathtimeout(AorB, s->buffer[s->windowfirst].path);
+  gobackN(AorB, flow);
 }
 
+/* called when an uncorrupted NAK arrives at the sender */
+static void nakinput(int AorB, int flow, int nakseq)
+{
+  struct sender *s = &snd[flow][AorB];
+
+  if (TRACE > 0)
+    printf("----%c: NAK %d is received\n", entityname[AorB], nakseq);
 
+  /* everything before the missing packet has arrived */
+  ackinput(AorB, flow, (nakseq + SEQSPACE - 1) % SEQSPACE);
 
-/********* Receiver (B)  variables and procedures ************/
+  /* go back to the missing packet now rather than wait for the timeout */
+  if (s->windowcount > 0 && s->buffer[s->windowfirst].seqnum == nakseq) {
+    if (TRACE > 0)
+      printf("----%c: NAKed packet is the window base, resend packets!\n", entityname[AorB]);
+    NAK_resends += s->windowcount;
+    gobackN(AorB, flow);
+  }
+}
 
-static int expectedseqnum; /* the sequence number expected next by the receiver */
-static int B_nextseqnum;   /* the sequence number for the next packets sent by B */
 
+/********* Receiver procedures ************/
 
-/* called from layer 3, when a packet arrives for layer 4 at B*/
-void B_input(struct pkt packet)
+/* called when an uncorrupted data packet arrives at the flow's receiver r */
+static void datainput(int AorB, int flow, struct receiver *r, struct pkt packet)
 {
-  struct pkt sendpkt;
-  int i;
+  bool filled = false;
+  int ahead;
 
-  /* if not corrupted and received packet is in order */
-  if  ( (!IsCorrupted(packet))  && (packet.seqnum == expectedseqnum) ) {
+  r->path = packet.path;
+
+  /* if received packet is in order */
+  if  (packet.seqnum == r->expectedseqnum) {
     if (TRACE > 0)
-      printf("----B: packet %d is correctly received, send ACK!\n",packet.seqnum);
+      printf("----%c: packet %d is correctly received, send ACK!\n", entityname[AorB], packet.seqnum);
     packets_received++;
 
     /* deliver to receiving application */
-    tolayer5(B, packet.payload);
-
-    /* send an ACK for the received packet */
-    sendpkt.acknum = expectedseqnum;
+    deliver(AorB, flow, packet);
 
     /* update state variables */
-    expectedseqnum = (expectedseqnum + 1) % SEQSPACE;        
+    r->expectedseqnum = (r->expectedseqnum + 1) % SEQSPACE;        
+
+    /* the packets buffered behind the gap it filled follow it up */
+    while (HOLDAHEAD && r->isheld[r->expectedseqnum]) {
+      r->isheld[r->expectedseqnum] = false;
+      hol_held++;
+      hol_delay += gettime() - r->heldtime[r->expectedseqnum];
+      packets_received++;
+      deliver(AorB, flow, r->held[r->expectedseqnum]);
+      r->expectedseqnum = (r->expectedseqnum + 1) % SEQSPACE;
+      filled = true;
+    }
+
+    /* hold the ACK back until ACKEVERY packets are covered by it or
+       ACKDELAY has passed, whichever is first.  With data flowing both
+       ways this gives the ACK a chance to ride on a data packet.  A
+       filled gap is ACKed straight away */
+    if ((DELAYEDACK || BIDIRECTIONAL) && !filled && r->unacked + 1 < ACKEVERY) {
+      if (r->unacked == 0)
+        ackdeadline[flow][AorB] = gettime() + ACKDELAY;
+      r->unacked++;
+      return;
+    }
   }
   else {
-    /* packet is corrupted or out of order resend last ACK */
+    /* with a reorder buffer, keep a packet that is less than a window
+       ahead, to deliver once the gap before it is filled */
+    ahead = (packet.seqnum - r->expectedseqnum + SEQSPACE) % SEQSPACE;
+    if (HOLDAHEAD && packet.seqnum >= 0 && packet.seqnum < SEQSPACE && ahead < WINDOWSIZE
+        && !r->isheld[packet.seqnum]) {
+      if (TRACE > 0)
+        printf("----%c: packet %d arrived ahead of a gap, buffer it\n", entityname[AorB], packet.seqnum);
+      r->held[packet.seqnum] = packet;
+      r->isheld[packet.seqnum] = true;
+      r->heldtime[packet.seqnum] = gettime();
+    }
+
+    /* packet is out of order: the expected packet is missing.  NAK it,
+       which also ACKs everything before it, or else resend last ACK
+       straight away, a gap means the sender is waiting to hear about it */
+    if (NAKS && sendNAK(AorB, flow, r->path, r->naktime, r->expectedseqnum)) {
+      r->unacked = 0;
+      ackdeadline[flow][AorB] = NOTINUSE;
+      return;
+    }
     if (TRACE > 0) 
-      printf("----B: packet corrupted or not expected sequence number, resend ACK!\n");
-    if (expectedseqnum == 0)
-      sendpkt.acknum = SEQSPACE - 1;
-    else
-      sendpkt.acknum = expectedseqnum - 1;
+      printf("----%c: packet corrupted or not expected sequence number, resend ACK!\n", entityname[AorB]);
   }
 
-  /* create packet */
-  sendpkt.seqnum = B_nextseqnum;
-  B_nextseqnum = (B_nextseqnum + 1) % 2;
-    
-  /* we don't have any data to send.  fill payload with 0's */
-  for ( i=0; i<20 ; i++ ) 
-    sendpkt.payload[i] = '0';  
+  sendACK(AorB, flow, r);
+}
 
-  /* computer checksum */
-  sendpkt.checksum = ComputeChecksum(sendpkt); 
 
-  /* send out packet */
-  tolayer3 (B, sendpkt);
+/********* Entry points, called by arq.c ************/
+
+/* act on one packet that has arrived, r being the receiver of its flow */
+void packetinput(int AorB, struct receiver *r, struct pkt packet)
+{
+  int flow = packet.flow;
+
+  if (IsCorrupted(packet) || !numbersinrange(packet)) {
+    /* anything may have been damaged, so treat it as a lost data packet
+       and resend the last ACK, if this entity is receiving data */
+    if (AorB == B || BIDIRECTIONAL) {
+      if (TRACE > 0) 
+        printf("----%c: packet corrupted or not expected sequence number, resend ACK!\n", entityname[AorB]);
+      sendACK(AorB, flow, r);
+    }
+    else
+      if (TRACE > 0)
+        printf ("----%c: corrupted ACK is received, do nothing!\n", entityname[AorB]);
+  }
+  else if (packet.seqnum == NAKSEQ)
+    nakinput(AorB, flow, packet.acknum);
+  else {
+    /* a data packet may carry an ACK, and a pure ACK carries no data */
+    if (packet.acknum != NOTINUSE)
+      ackinput(AorB, flow, packet.acknum);
+    if (packet.seqnum != NOTINUSE)
+      datainput(AorB, flow, r, packet);
+  }
+}
+
+/* a pure ACK in a batch is only counted if the next, another for the same
+   flow, reaches past it, as acting on it would only slide the window part
+   of the way the next one does */
+bool foldACK(int AorB, struct pkt packet, struct pkt next)
+{
+  int reach = ackreach(AorB, packet.flow, packet.acknum);
+
+  if (reach > 0 && ackreach(AorB, packet.flow, next.acknum) <= reach)
+    return false;
+  if (TRACE > 0)
+    printf("----%c: ACK %d is folded into a later one\n", entityname[AorB], packet.acknum);
+  total_ACKs_received++;
+  if (reach > 0)
+    new_ACKs++;
+  return true;
 }
 
-/* the following routine will be called once (only) before any other */
-/* entity B routines are called. You can use it to do any initialization */
-void B_init(void)
+/* no data went out to carry the held back ACK, so send it on its own */
+void sendheldACK(int AorB, int flow)
 {
-  expectedseqnum = 0;
-  B_nextseqnum = 1;
+  sendACK(AorB, flow, &rcv[flow][AorB]);
 }
 
-/******************************************************************************
- * The following functions need be completed only for bi-directional messages *
- *****************************************************************************/
+/* the receiver half of a flow */
+struct receiver *receiverof(int AorB, int flow)
+{
+  return &rcv[flow][AorB];
+}
 
-/* Note that with simplex transfer from a-to-B, there is no B_output() */
-void B_output(struct msg message)  
+/* initialise a receiver half, expecting sequence number 0 */
+void initreceiver(struct receiver *r)
 {
+  int i;
+
+  /* B discards the packets that follow a lost one, so by the time parity
+     rebuilds it they are gone and A goes back for them all the same */
+  if (fec_on() && !HOLDAHEAD) {
+    printf("FEC only helps Go-Back-N if B keeps packets that arrive ahead of a gap: set REORDERBUF\n");
+    exit(EXIT_FAILURE);
+  }
+
+  r->expectedseqnum = 0;
+  r->unacked = 0;
+  r->path = 0;
+
+  for (i = 0; i < SEQSPACE; i++) {
+    r->naktime[i] = NOTINUSE;
+    r->isheld[i] = false;
+  }
 }
 
-/* called when B's timer goes off */
-void B_timerinterrupt(void)
+/* initialise a sender half's window and sequence number */
+void initsender(int AorB, int flow)
 {
+  snd[flow][AorB].nextseqnum = 0;  /* A starts with seq num 0, do not change this */
+  snd[flow][AorB].windowfirst = 0;
+  snd[flow][AorB].windowlast = -1;   /* windowlast is where the last packet sent is stored.  
+  		     new packets are placed in winlast + 1 
+  		     so initially this is set to -1
+  		   */
+  snd[flow][AorB].windowcount = 0;
 }
 
@@ -0,0 +1,347 @@
+/* ******************************************************************
+   Impairment proxy: sits between two local UDP endpoints and does to
+   their datagrams what the emulator's channel does to packets, with the
+   same models (channel.c): each may be lost, corrupted, or delayed by
+   the channel's delay after the one ahead of it, in its own direction.
+   Any program can then be tried against the channel the simulations use.
+
+   An endpoint at port p talks to the proxy at p + 1.  The proxy takes A's
+   datagrams on aport + 1 and passes them to B at bport, and B's on
+   bport + 1 to A at aport.  With the UDP backend:
+     gcc -O2 -o gbn_proxy proxy.c channel.c wire.c -lm
+     ./gbn_proxy 0.1 0.1 &
+     ./gbn_udp B 0 0 40002 40003 &
+     ./gbn_udp A 100000 0.05
+
+   Datagrams wait in a hashed timing wheel of TICKNS slots and are sent
+   once the slot they are due in has passed, so none goes out early and
+   none more than a tick late, on top of how long a turn of the loop
+   takes.  The loop polls the sockets rather than sleeping, to keep that
+   short, giving up the CPU only when nothing has arrived for SPINS polls.
+   The original channel, each datagram 1 to 10 time units behind the one
+   ahead of it, carries about one every 5.5 units each way; to pass
+   datagrams at a high rate, use PROFILES with a short delay.  Datagrams
+   that decode as packets in the wire format (wire.c) are corrupted as the
+   emulator corrupts packets, and encoded again; others are only lost and
+   delayed.  The proxy stops once nothing has arrived for IDLE time units,
+   and reports what it did each way and how late datagrams went out.
+   Linux only.
+**********************************************************************/
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sched.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include "emulator.h"
+#include "channel.h"
+#include "wire.h"
+
+#define PORT 40000           /* A's port in udp.c */
+#define UNITNS 1000000       /* nanoseconds in one time unit, as in udp.c */
+#define TICKNS 1000          /* nanoseconds in one slot of the timing wheel */
+#define WHEELBITS 16         /* the wheel has 2^WHEELBITS slots, a turn of 65 ms */
+#define POOLSIZE 65536       /* datagrams that can be waiting at once */
+#define MAXDGRAM 2048        /* the longest datagram passed on */
+#define BATCH 64             /* the most datagrams moved by one sendmmsg or recvmmsg */
+#define SOCKBUF (4 << 20)    /* bytes of socket buffer each way, for bursts */
+#define LATENS 10000         /* datagrams sent later than this after they were due are counted */
+#define IDLE 3000.0          /* time units without a datagram before the proxy stops */
+#define SPINS 1              /* polls with nothing arriving before giving up the CPU, 0 never, with a core to itself */
+
+/* a datagram held until it is due */
+struct held {
+  int64_t due;
+  int len;
+  int to;                         /* A or B, the endpoint it goes out to */
+  struct held *next;
+  _Alignas(16) char data[MAXDGRAM];
+};
+
+static struct held pool[POOLSIZE];
+static struct held *freelist;
+static struct held *slots[1 << WHEELBITS];     /* each slot's datagrams, in the order they are due */
+static struct held **slottail[1 << WHEELBITS]; /* where the next one in a slot goes */
+static int64_t wheeltick;         /* the next tick to be passed */
+static int64_t lastdue[2];        /* when the last datagram each way is due */
+
+static int sock[2];               /* sock[A] faces A, sock[B] faces B */
+static struct held *outq[2][BATCH]; /* datagrams to go out to A or to B */
+static int noutq[2];
+
+/* statistics, for datagrams from A and from B */
+static int dgrams_in[2];          /* number received */
+static int dgrams_lost[2];        /* number lost by the channel models */
+static int dgrams_corrupted[2];   /* number corrupted by them */
+static int dgrams_out[2];         /* number passed on */
+static int dgrams_dropped[2];     /* number the socket would not take */
+static int64_t total_late;        /* sum of how late datagrams went out, in nanoseconds */
+static int64_t max_late;          /* the latest one */
+static int nlate;                 /* number more than LATENS late */
+
+/* the monotonic clock, in nanoseconds */
+static int64_t nowns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* the channel models' random numbers */
+double jimsrand(void)
+{
+  return (double)rand() / RAND_MAX;
+}
+
+/* hold a datagram in the slot of the tick it is due in */
+static void schedule(struct held *h)
+{
+  int slot = (h->due / TICKNS) & ((1 << WHEELBITS) - 1);
+
+  h->next = NULL;
+  *slottail[slot] = h;
+  slottail[slot] = &h->next;
+}
+
+/* send every datagram waiting to go out one way, a batch to a system call */
+static void flush(int to)
+{
+  struct mmsghdr msgs[BATCH];
+  struct iovec iovs[BATCH];
+  int i, n, sent = 0;
+
+  memset(msgs, 0, sizeof msgs);
+  for (i = 0; i < noutq[to]; i++) {
+    iovs[i].iov_base = outq[to][i]->data;
+    iovs[i].iov_len = outq[to][i]->len;
+    msgs[i].msg_hdr.msg_iov = &iovs[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
+  }
+  while (sent < noutq[to]) {
+    n = sendmmsg(sock[to], msgs + sent, noutq[to] - sent, 0);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      if (errno != EAGAIN && errno != EWOULDBLOCK && errno != ECONNREFUSED) {
+        perror("sendmmsg");
+        exit(EXIT_FAILURE);
+      }
+      /* the rest are lost, as the network might lose them */
+      dgrams_dropped[1 - to] += noutq[to] - sent;
+      break;
+    }
+    dgrams_out[1 - to] += n;
+    sent += n;
+  }
+  for (i = 0; i < noutq[to]; i++) {
+    outq[to][i]->next = freelist;
+    freelist = outq[to][i];
+  }
+  noutq[to] = 0;
+}
+
+/* pass every tick that has ended by now, sending what was due in it.  A
+   slot also holds datagrams due a turn or more later, which stay */
+static void release(int64_t now)
+{
+  struct held **p, *h;
+  int64_t late;
+  int slot, to;
+
+  while (wheeltick < now / TICKNS) {
+    slot = wheeltick & ((1 << WHEELBITS) - 1);
+    p = &slots[slot];
+    while ((h = *p) != NULL) {
+      if (h->due / TICKNS > wheeltick) {
+        p = &h->next;
+        continue;
+      }
+      *p = h->next;
+      late = now - h->due;
+      total_late += late;
+      if (late > max_late)
+        max_late = late;
+      if (late > LATENS)
+        nlate++;
+      to = h->to;
+      if (noutq[to] == BATCH)
+        flush(to);
+      outq[to][noutq[to]++] = h;
+    }
+    slottail[slot] = p;
+    wheeltick++;
+  }
+}
+
+/* take the datagrams waiting from A or B, a batch to a system call, and
+   put each through the channel.  Returns how many there were */
+static int receive(int from, int64_t now)
+{
+  struct mmsghdr msgs[BATCH];
+  struct iovec iovs[BATCH];
+  struct held *got[BATCH];
+  struct pkt packet;
+  int i, n, k;
+
+  for (k = 0; k < BATCH && freelist != NULL; k++) {
+    got[k] = freelist;
+    freelist = freelist->next;
+  }
+  memset(msgs, 0, sizeof msgs);
+  for (i = 0; i < k; i++) {
+    iovs[i].iov_base = got[i]->data;
+    iovs[i].iov_len = MAXDGRAM;
+    msgs[i].msg_hdr.msg_iov = &iovs[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
+  }
+  /* with the pool used up, datagrams wait in the socket */
+  n = k > 0 ? recvmmsg(sock[from], msgs, k, MSG_DONTWAIT, NULL) : 0;
+  if (n < 0) {
+    if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR && errno != ECONNREFUSED) {
+      perror("recvmmsg");
+      exit(EXIT_FAILURE);
+    }
+    n = 0;
+  }
+  for (i = n; i < k; i++) {
+    got[i]->next = freelist;
+    freelist = got[i];
+  }
+
+  for (i = 0; i < n; i++) {
+    dgrams_in[from]++;
+    if (channelloss(from) && lossapplies(from)) {
+      dgrams_lost[from]++;
+      got[i]->next = freelist;
+      freelist = got[i];
+      continue;
+    }
+    got[i]->len = msgs[i].msg_len;
+    if (wire_decode((unsigned char *)got[i]->data, got[i]->len, &packet) == 0
+        && channelcorrupt(from, &packet) > 0) {
+      dgrams_corrupted[from]++;
+      got[i]->len = wire_encode(&packet, (unsigned char *)got[i]->data);
+    }
+
+    /* each arrives a delay after the one ahead of it, as in the emulator */
+    if (lastdue[from] < now)
+      lastdue[from] = now;
+    lastdue[from] += channeldelay(from) * UNITNS;
+    got[i]->due = lastdue[from];
+    got[i]->to = 1 - from;
+    schedule(got[i]);
+  }
+  return n;
+}
+
+/* a socket bound to port, that sends only to peerport */
+static int endpoint(int port, int peerport)
+{
+  struct sockaddr_in addr;
+  int s, size = SOCKBUF;
+
+  s = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+  if (s < 0) {
+    perror("socket");
+    exit(EXIT_FAILURE);
+  }
+  setsockopt(s, SOL_SOCKET, SO_RCVBUF, &size, sizeof size);
+  setsockopt(s, SOL_SOCKET, SO_SNDBUF, &size, sizeof size);
+  memset(&addr, 0, sizeof addr);
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(port);
+  if (bind(s, (struct sockaddr *)&addr, sizeof addr) < 0) {
+    perror("bind");
+    exit(EXIT_FAILURE);
+  }
+  addr.sin_port = htons(peerport);
+  if (connect(s, (struct sockaddr *)&addr, sizeof addr) < 0) {
+    perror("connect");
+    exit(EXIT_FAILURE);
+  }
+  return s;
+}
+
+int main(int argc, char *argv[])
+{
+  int64_t now, first = -1, lastheard;
+  struct rusage ru;
+  double elapsed, cpu;
+  int aport, bport, i, n, released, idle = 0;
+
+  if (argc < 3) {
+    printf("usage: %s lossprob corruptprob [aport bport]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  lossprob = atof(argv[1]);
+  corruptprob = atof(argv[2]);
+  corruptdirection = 2;           /* both directions */
+  aport = argc > 4 ? atoi(argv[3]) : PORT;
+  bport = argc > 4 ? atoi(argv[4]) : PORT + 2;
+  srand(9999);
+  channel_init();
+
+  sock[A] = endpoint(aport + 1, aport);
+  sock[B] = endpoint(bport + 1, bport);
+  for (i = POOLSIZE - 1; i >= 0; i--) {
+    pool[i].next = freelist;
+    freelist = &pool[i];
+  }
+  for (i = 0; i < 1 << WHEELBITS; i++)
+    slottail[i] = &slots[i];
+  lastheard = nowns();
+  wheeltick = lastheard / TICKNS;
+
+  while (1) {
+    now = nowns();
+    n = receive(A, now) + receive(B, now);
+    if (n > 0) {
+      lastheard = now;
+      if (first < 0)
+        first = now;
+      idle = 0;
+    }
+    release(now);
+    flush(A);
+    flush(B);
+
+    released = dgrams_out[A] + dgrams_dropped[A] + dgrams_out[B] + dgrams_dropped[B];
+    if (first >= 0 && now - lastheard >= IDLE * UNITNS
+        && released == dgrams_in[A] - dgrams_lost[A] + dgrams_in[B] - dgrams_lost[B])
+      break;
+    if (SPINS > 0 && ++idle >= SPINS) {
+      sched_yield();
+      idle = 0;
+    }
+  }
+
+  elapsed = first >= 0 ? (lastheard - first) / 1e9 : 0.0;
+  printf("proxy: %f seconds from the first datagram to the last\n", elapsed);
+  for (i = A; i <= B; i++)
+    printf("%s:  %d datagrams received, %d lost, %d corrupted, %d passed on, %d not taken by the socket \n",
+           i == A ? "A->B" : "B->A", dgrams_in[i], dgrams_lost[i], dgrams_corrupted[i],
+           dgrams_out[i], dgrams_dropped[i]);
+  if (elapsed > 0.0)
+    printf("datagrams received per second:  %f \n", (dgrams_in[A] + dgrams_in[B]) / elapsed);
+  /* what one core to itself could carry, the proxy never waiting */
+  getrusage(RUSAGE_SELF, &ru);
+  cpu = ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6 + ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+  if (cpu > 0.0)
+    printf("datagrams received per second of CPU time:  %f \n", (dgrams_in[A] + dgrams_in[B]) / cpu);
+  released = dgrams_out[A] + dgrams_dropped[A] + dgrams_out[B] + dgrams_dropped[B];
+  if (released > 0)
+    printf("how late datagrams went out:  %f us on average, %f us at most, %d over %d us \n",
+           total_late / 1e3 / released, max_late / 1e3, nlate, LATENS / 1000);
+  return EXIT_SUCCESS;
+}
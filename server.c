@@ -0,0 +1,400 @@
+/* ******************************************************************
+   Receiver server: terminates many senders at once over loopback UDP.
+   Each sender's flow is a session with B's receiver state of its own,
+   kept in a hash table keyed by the sender's address and port and the
+   flow.  A worker process per core runs an epoll loop on a socket of its
+   own, all of them bound to B's port with SO_REUSEPORT, so the kernel
+   spreads the senders across the workers and keeps each on the same one.
+   ACKs go back in batches with sendmmsg.
+
+   Build both with the same NFLOWS, start the server, then the senders,
+   the A side of udp.c, each on a port of its own:
+     gcc -O2 -DNFLOWS=256 -o gbn_server server.c wire.c stats.c arq.c gbn.c fec.c -lm
+     gcc -O2 -DNFLOWS=256 -o gbn_udp udp.c wire.c stats.c arq.c gbn.c fec.c -lm
+     ./gbn_server 4 &
+     for i in 0 1 2 3 4 5 6 7; do ./gbn_udp A 100000 0.05 4100$i & done
+
+   A worker stops once it has heard nothing for IDLE time units, from its
+   start or its last packet, and reports how many sessions it held, how many
+   packets and ACKs it moved a second and how much of a core that took,
+   which shows how many sessions the box can terminate before it
+   saturates.  Linux only.
+**********************************************************************/
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include "emulator.h"
+#include "gbn.h"
+#include "wire.h"
+
+#if BIDIRECTIONAL
+#error "the server only receives: BIDIRECTIONAL must be 0"
+#endif
+
+#define PORT 40001           /* the port B listens on in udp.c */
+#define UNITNS 1000000       /* nanoseconds in one time unit, as in udp.c */
+#define BATCH 64             /* the most datagrams moved by one sendmmsg or recvmmsg */
+#define HASHBITS 16          /* the session table has 2^HASHBITS chains */
+#define SESSIONIDLE 5000.0   /* time units without a packet before a session is dropped */
+#define IDLE 10000.0         /* time units without a packet, or from the start, before a worker stops */
+
+int TRACE = 0;
+
+/* statistics updated by the server */
+static int messages_delivered;    /* number delivered to layer 5 */
+static double total_latency;      /* sum of the times from offering a message to delivering it */
+static int packets_in;            /* number of datagrams received */
+static int packets_sent;          /* number of ACKs sent */
+static int packets_dropped;       /* number the socket would not take */
+static int send_calls;            /* number of sendmmsg calls */
+static int recv_calls;            /* number of recvmmsg calls that returned datagrams */
+static int sessions_opened;       /* number of sessions begun */
+static int sessions_closed;       /* number dropped for being idle */
+static int sessions_live;         /* number held now */
+static int sessions_max;          /* the most ever held at once */
+
+/* a sender's flow, and B's receiver state for it */
+struct session {
+  uint64_t key;                   /* address, port and flow, as sessionkey() packs them */
+  struct sockaddr_in addr;        /* where its ACKs go */
+  float lastheard;                /* when its last packet arrived */
+  struct session *next;           /* the next session in its chain */
+  _Alignas(16) char state[];      /* B_sessionsize() bytes */
+};
+
+static struct session *table[1 << HASHBITS];
+static struct session *current;   /* the session whose packet B is acting on */
+static int sock;
+static int64_t startns;           /* the clock when the worker started */
+
+static struct pkt outq[BATCH];    /* ACKs waiting to be sent, oldest first */
+static struct sockaddr_in outaddr[BATCH]; /* and where each goes */
+static int noutq;
+
+/* the monotonic clock, in nanoseconds */
+static int64_t nowns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* the key of a sender's flow: address, port and flow packed together */
+static uint64_t sessionkey(struct sockaddr_in *addr, int flow)
+{
+  return (uint64_t)addr->sin_addr.s_addr << 32 | (uint64_t)addr->sin_port << 16 | (flow & 0xffff);
+}
+
+/* the chain a key is in, from the top bits of a multiplicative hash */
+static int chain(uint64_t key)
+{
+  return (key * 0x9E3779B97F4A7C15ull) >> (64 - HASHBITS);
+}
+
+/* find a sender's session, beginning one if it has none */
+static struct session *lookup(struct sockaddr_in *addr, int flow)
+{
+  uint64_t key = sessionkey(addr, flow);
+  struct session **head = &table[chain(key)];
+  struct session *s;
+
+  for (s = *head; s != NULL; s = s->next)
+    if (s->key == key)
+      return s;
+
+  s = malloc(sizeof(struct session) + B_sessionsize());
+  if (s == NULL) {
+    printf("memory allocation for a session failed.");
+    exit(EXIT_FAILURE);
+  }
+  s->key = key;
+  s->addr = *addr;
+  B_sessioninit(s->state);
+  s->next = *head;
+  *head = s;
+  sessions_opened++;
+  if (++sessions_live > sessions_max)
+    sessions_max = sessions_live;
+  return s;
+}
+
+/* drop the sessions that have heard nothing for SESSIONIDLE */
+static void sweep(float now)
+{
+  struct session **p, *s;
+  int i;
+
+  for (i = 0; i < 1 << HASHBITS; i++) {
+    p = &table[i];
+    while ((s = *p) != NULL) {
+      if (now - s->lastheard >= SESSIONIDLE) {
+        *p = s->next;
+        free(s);
+        sessions_closed++;
+        sessions_live--;
+      }
+      else
+        p = &s->next;
+    }
+  }
+}
+
+/* send every ACK waiting in the queue, a batch to a system call */
+static void flush(void)
+{
+  struct mmsghdr msgs[BATCH];
+  struct iovec iovs[BATCH];
+  unsigned char bufs[BATCH][WIREMAX];
+  int i, n, sent = 0;
+
+  memset(msgs, 0, sizeof msgs);
+  for (i = 0; i < noutq; i++) {
+    iovs[i].iov_base = bufs[i];
+    iovs[i].iov_len = wire_encode(&outq[i], bufs[i]);
+    msgs[i].msg_hdr.msg_name = &outaddr[i];
+    msgs[i].msg_hdr.msg_namelen = sizeof outaddr[i];
+    msgs[i].msg_hdr.msg_iov = &iovs[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
+  }
+  while (sent < noutq) {
+    n = sendmmsg(sock, msgs + sent, noutq - sent, 0);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      if (errno != EAGAIN && errno != EWOULDBLOCK && errno != ECONNREFUSED) {
+        perror("sendmmsg");
+        exit(EXIT_FAILURE);
+      }
+      /* the rest are lost, as the network might lose them */
+      packets_dropped += noutq - sent;
+      break;
+    }
+    send_calls++;
+    packets_sent += n;
+    sent += n;
+  }
+  noutq = 0;
+}
+
+/* take every datagram waiting on the socket, a batch to a system call, and
+   have B act on each against the state of the session it belongs to */
+static void receive(void)
+{
+  struct mmsghdr msgs[BATCH];
+  struct iovec iovs[BATCH];
+  unsigned char bufs[BATCH][WIREMAX + 1]; /* a byte over, so a longer datagram does not decode */
+  struct pkt packet;
+  struct sockaddr_in addrs[BATCH];
+  float now;
+  int i, n;
+
+  while (1) {
+    memset(msgs, 0, sizeof msgs);
+    for (i = 0; i < BATCH; i++) {
+      iovs[i].iov_base = bufs[i];
+      iovs[i].iov_len = sizeof bufs[i];
+      msgs[i].msg_hdr.msg_name = &addrs[i];
+      msgs[i].msg_hdr.msg_namelen = sizeof addrs[i];
+      msgs[i].msg_hdr.msg_iov = &iovs[i];
+      msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    n = recvmmsg(sock, msgs, BATCH, MSG_DONTWAIT, NULL);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        perror("recvmmsg");
+        exit(EXIT_FAILURE);
+      }
+      return;
+    }
+    recv_calls++;
+    now = gettime();
+    for (i = 0; i < n; i++) {
+      if (wire_decode(bufs[i], msgs[i].msg_len, &packet) < 0)
+        continue;
+      packets_in++;
+      current = lookup(&addrs[i], packet.flow);
+      current->lastheard = now;
+      B_sessioninput(current->state, packet);
+    }
+    if (n < BATCH)
+      return;
+  }
+}
+
+/********************** Student-callable ROUTINES ***********************/
+
+float gettime(void)
+{
+  return (double)(nowns() - startns) / UNITNS;
+}
+
+/* the sessions have no timers of their own.  B_sessioninit() refuses the
+   options that would set B's timer, so these are never called */
+void starttimer(int AorB, double increment)
+{
+  (void)increment;
+  printf("%c started a timer, which a server does not keep\n", AorB == A ? 'A' : 'B');
+  abort();
+}
+
+void starttimer_slack(int AorB, double increment, double slack)
+{
+  (void)slack;
+  starttimer(AorB, increment);
+}
+
+void stoptimer(int AorB)
+{
+  printf("%c stopped a timer, which a server does not keep\n", AorB == A ? 'A' : 'B');
+  abort();
+}
+
+/* ACKs are queued, each to the session B is acting for, and go out
+   together once the batch of datagrams in hand is done */
+void tolayer3_batch(int AorB, struct pkt packets[], int count)
+{
+  int k;
+
+  (void)AorB;
+  for (k = 0; k < count; k++) {
+    if (noutq == BATCH)
+      flush();
+    outaddr[noutq] = current->addr;
+    outq[noutq++] = packets[k];
+  }
+}
+
+void tolayer3(int AorB, struct pkt packet)
+{
+  tolayer3_batch(AorB, &packet, 1);
+}
+
+void tolayer5(int AorB, char datasent[20])
+{
+  int64_t stamp;
+
+  (void)AorB;
+  memcpy(&stamp, datasent, sizeof stamp);
+  total_latency += (double)(nowns() - stamp) / UNITNS;
+  messages_delivered++;
+}
+
+/* one worker: an epoll loop on a socket of its own, sharing the port */
+static void worker(int id)
+{
+  static char out[4096];
+  struct sockaddr_in addr;
+  struct epoll_event ev;
+  struct rusage ru;
+  double elapsed, cpu, firstheard = -1.0, lastheard = 0.0, lastsweep = 0.0;
+  int one = 1, ep;
+
+  sock = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+  if (sock < 0 || setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &one, sizeof one) < 0) {
+    perror("socket");
+    exit(EXIT_FAILURE);
+  }
+  memset(&addr, 0, sizeof addr);
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(PORT);
+  if (bind(sock, (struct sockaddr *)&addr, sizeof addr) < 0) {
+    perror("bind");
+    exit(EXIT_FAILURE);
+  }
+  ep = epoll_create1(0);
+  if (ep < 0) {
+    perror("epoll_create1");
+    exit(EXIT_FAILURE);
+  }
+  ev.events = EPOLLIN;
+  ev.data.fd = sock;
+  epoll_ctl(ep, EPOLL_CTL_ADD, sock, &ev);
+
+  startns = nowns();
+  B_init();
+
+  while (1) {
+    if (epoll_wait(ep, &ev, 1, 100) > 0) {
+      receive();
+      flush();
+      lastheard = gettime();
+      if (firstheard < 0.0)
+        firstheard = lastheard;
+    }
+    if (gettime() - lastsweep >= SESSIONIDLE) {
+      lastsweep = gettime();
+      sweep(lastsweep);
+    }
+    if (gettime() - lastheard >= IDLE)
+      break;
+  }
+  if (firstheard < 0.0) {
+    printf("worker %d: no senders\n", id);
+    exit(EXIT_SUCCESS);
+  }
+
+  /* from the first packet to the last, not through the idle time after;
+     the CPU time is nearly all spent in that span */
+  elapsed = (lastheard - firstheard) * UNITNS / 1e9;
+  if (elapsed <= 0.0)
+    elapsed = 1e-9;
+  getrusage(RUSAGE_SELF, &ru);
+  cpu = ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6 + ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+
+  /* one write for the report, so the workers' reports do not interleave */
+  setvbuf(stdout, out, _IOFBF, sizeof out);
+  printf("worker %d: %f seconds from its first packet to its last\n", id, elapsed);
+  printf("sessions:  %d opened, %d dropped idle, at most %d at once, %d bytes of receiver state each \n",
+         sessions_opened, sessions_closed, sessions_max, B_sessionsize());
+  printf("number of packets received:  %d, in %d recvmmsg calls, %f per second \n",
+         packets_in, recv_calls, packets_in / elapsed);
+  printf("number of ACKs sent:  %d, in %d sendmmsg calls, %d not taken by the socket, %f per second \n",
+         packets_sent, send_calls, packets_dropped, packets_sent / elapsed);
+  printf("number of messages delivered to application:  %d \n", messages_delivered);
+  if (messages_delivered > 0)
+    printf("average time from offering a message to delivering it:  %f \n", total_latency / messages_delivered);
+  printf("share of a core used:  %f \n", cpu / elapsed);
+  fflush(stdout);
+  exit(EXIT_SUCCESS);
+}
+
+int main(int argc, char *argv[])
+{
+  int nworkers, i;
+
+  nworkers = argc > 1 ? atoi(argv[1]) : sysconf(_SC_NPROCESSORS_ONLN);
+  if (nworkers < 1) {
+    printf("usage: %s [nworkers]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  fflush(stdout);
+  for (i = 0; i < nworkers; i++) {
+    switch (fork()) {
+    case -1:
+      perror("fork");
+      return EXIT_FAILURE;
+    case 0:
+      worker(i);
+    }
+  }
+  while (wait(NULL) > 0)
+    ;
+  return EXIT_SUCCESS;
+}
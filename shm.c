@@ -0,0 +1,452 @@
+/* ******************************************************************
+   Shared memory backend: runs the same protocol code as the emulator, with
+   A and B in separate processes on one host, exchanging packets through a
+   pair of lock-free rings in a shared memory segment.  Each ring has one
+   producer and one consumer, so a packet is passed with a plain copy into
+   a slot and one atomic store, and no system call is made on the way.
+   Each side polls its incoming ring, its timer and its next message in a
+   loop, reading the clock through the vDSO, and gives up the CPU only
+   when nothing has arrived for SPINS polls.
+
+   With IMPAIR on, a sender puts each packet through the emulator's own
+   channel models (channel.c) on its way into the ring: it may be lost or
+   corrupted, and is not taken out before the delay the channel gives it.
+
+   With PRODUCERS above 0, A's messages come instead from that many
+   threads, submitting them through submit.c as fast as A takes them, to
+   measure what the submission queue can carry.  lambda is then unused.
+
+   Build and run; B is forked from A:
+     gcc -O2 -pthread -o gbn_shm shm.c submit.c channel.c stats.c arq.c gbn.c fec.c -lm
+     ./gbn_shm 1000000 0.5 [lossprob corruptprob]
+
+   A offers nmsgs messages, one every lambda time units on average, as the
+   emulator does, and B none.  A side stops once it has offered them all,
+   has no timer running and has heard nothing for LINGER time units, and
+   the other side has done the same.  Linux only.
+**********************************************************************/
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "emulator.h"
+#include "channel.h"
+#include "gbn.h"
+#include "submit.h"
+
+#define IMPAIR 0             /* 1 = lose, corrupt and delay packets as the emulator's channel does */
+#define UNITNS 1000          /* nanoseconds in one time unit, so an RTT of 16 is 16 us */
+#define RINGSIZE 1024        /* slots in each ring, a power of 2 */
+#define BATCH 64             /* the most packets taken from the ring for one call into the entity */
+#define LINGER 1000.0        /* time units without a packet before a side that is done stops */
+#define PRODUCERS 0          /* 0 = A offers its own messages, N = N threads submit them through submit.c */
+#define SPINS 1              /* polls with nothing arriving before giving up the CPU, 0 never, with a core for each side */
+
+int TRACE = 0;
+
+/* statistics updated by the backend */
+static int messages_offered;      /* number of messages given to the protocol */
+static int messages_delivered;    /* number delivered to layer 5 */
+static double total_latency;      /* sum of the times from offering a message to delivering it */
+static int packets_sent;          /* number of packets put in the ring */
+static int packets_dropped;       /* number the ring had no room for */
+static int packets_lost;          /* number lost by the channel models */
+static int packets_corrupted;     /* number corrupted by them */
+static int packets_in;            /* number of packets taken from the ring */
+static int yields;                /* number of times the CPU was given up while idle */
+
+/* a packet in a ring, and the time it may be taken out */
+struct slot {
+  int64_t due;
+  struct pkt packet;
+};
+
+/* the producer and the consumer each write only their own index, on a
+   cache line of its own, and publish it with a release store */
+struct ring {
+  _Alignas(64) atomic_uint head;  /* the next slot to take, written by the consumer */
+  _Alignas(64) atomic_uint tail;  /* the next slot to fill, written by the producer */
+  _Alignas(64) struct slot slots[RINGSIZE];
+};
+
+/* the shared memory segment */
+struct segment {
+  struct ring rings[2];           /* rings[A] carries packets from A to B */
+  atomic_int done[2];             /* A or B has finished, and waits only for the other */
+};
+
+static struct segment *seg;
+static int side;                  /* A or B, the entity this process runs */
+static unsigned int head;         /* our copy of the incoming ring's head */
+static unsigned int tail;         /* our copy of the outgoing ring's tail */
+static unsigned int peerhead;     /* the outgoing ring's head, when last read */
+static int64_t lastdue;           /* when the last packet sent may be taken out */
+static bool timerrunning;
+static int64_t timerdue;          /* when the entity's timer goes off */
+static int64_t startns;           /* the clock when the run started */
+static int nmsgs;                 /* the messages A offers */
+
+/* a thread submitting messages */
+struct producer {
+  pthread_t thread;
+  int id;
+  int refused;                    /* times the queue was full */
+  int64_t done;                   /* when it had submitted all its messages */
+};
+
+static struct producer producers[PRODUCERS > 0 ? PRODUCERS : 1];
+
+/* the monotonic clock, in nanoseconds */
+static int64_t nowns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* the channel models' random numbers, from this process's own sequence */
+double jimsrand(void)
+{
+  return (double)rand() / RAND_MAX;
+}
+
+/* hand packets copied out of the ring to the entity in one call, and give
+   their slots back to the sender */
+static void handover(struct ring *r, struct pkt packets[], int k)
+{
+  atomic_store_explicit(&r->head, head, memory_order_release);
+  if (side == A)
+    A_input_batch(packets, k);
+  else
+    B_input_batch(packets, k);
+  packets_in += k;
+}
+
+/* take every packet in the incoming ring that is due, and hand them to the
+   entity, up to BATCH in a call.  Returns how many there were */
+static int receive(void)
+{
+  struct ring *r = &seg->rings[1 - side];
+  unsigned int avail = atomic_load_explicit(&r->tail, memory_order_acquire);
+  struct slot *s;
+  struct pkt packets[BATCH];
+  int64_t now = IMPAIR ? nowns() : 0;
+  int n = 0;
+  int k = 0;
+
+  while (head != avail) {
+    s = &r->slots[head & (RINGSIZE - 1)];
+    if (s->due > now)
+      break;                      /* the rest are behind it */
+    packets[k++] = s->packet;
+    head++;
+    n++;
+    if (k == BATCH) {
+      handover(r, packets, k);
+      k = 0;
+    }
+  }
+  if (k > 0)
+    handover(r, packets, k);
+  return n;
+}
+
+/* the kth message, stamped with the time */
+static struct msg makemessage(int k)
+{
+  struct msg message;
+  int64_t stamp = nowns();
+  int i;
+
+  for (i = 0; i < 20; i++)
+    message.data[i] = 'a' + k % 26;
+  memcpy(message.data, &stamp, sizeof stamp);
+  message.flow = k % NFLOWS;
+  return message;
+}
+
+/* layer 5 offers the entity its next message */
+static void offer(void)
+{
+  struct msg message = makemessage(messages_offered);
+
+  flow_offered[message.flow]++;
+  messages_offered++;
+  if (side == A)
+    A_output(message);
+  else
+    B_output(message);
+}
+
+/* a submitting thread: its share of the messages, each submitted as soon
+   as the queue has room for it */
+static void *produce(void *arg)
+{
+  struct producer *p = arg;
+  struct msg message;
+  int k;
+
+  for (k = p->id; k < nmsgs; k += PRODUCERS) {
+    message = makemessage(k);
+    while (!submit(message)) {
+      p->refused++;
+      sched_yield();
+    }
+  }
+  p->done = nowns();
+  return NULL;
+}
+
+/* the time until the next message, uniform on [0, 2 lambda] */
+static int64_t nextgap(double lambda)
+{
+  return lambda * 2 * rand() / RAND_MAX * UNITNS;
+}
+
+/********************** Student-callable ROUTINES ***********************/
+
+float gettime(void)
+{
+  return (double)(nowns() - startns) / UNITNS;
+}
+
+void starttimer(int AorB, double increment)
+{
+  (void)AorB;
+  if (timerrunning) {
+    printf("Warning: attempt to start a timer that is already started\n");
+    return;
+  }
+  timerdue = nowns() + (int64_t)(increment * UNITNS);
+  timerrunning = true;
+}
+
+/* the timer is only a deadline here, so setting it again costs nothing to
+   save, and the slack is not used */
+void starttimer_slack(int AorB, double increment, double slack)
+{
+  (void)slack;
+  starttimer(AorB, increment);
+}
+
+void stoptimer(int AorB)
+{
+  (void)AorB;
+  if (!timerrunning) {
+    printf("Warning: unable to cancel your timer. It wasn't running.\n");
+    return;
+  }
+  timerrunning = false;
+}
+
+/* the packets go into the outgoing ring together, published to the other
+   side by one store of the tail */
+void tolayer3_batch(int AorB, struct pkt packets[], int count)
+{
+  struct ring *r = &seg->rings[side];
+  struct slot *s;
+  int64_t now;
+  int k;
+
+  (void)AorB;
+  for (k = 0; k < count; k++) {
+    if (IMPAIR && channelloss(side) && lossapplies(side)) {
+      packets_lost++;
+      continue;
+    }
+    if (tail - peerhead == RINGSIZE) {
+      peerhead = atomic_load_explicit(&r->head, memory_order_acquire);
+      if (tail - peerhead == RINGSIZE) {
+        /* the other side is behind: lost, as a full queue would lose it */
+        packets_dropped++;
+        continue;
+      }
+    }
+    s = &r->slots[tail & (RINGSIZE - 1)];
+    s->packet = packets[k];
+    s->due = 0;
+    if (IMPAIR) {
+      if (channelcorrupt(side, &s->packet) > 0)
+        packets_corrupted++;
+      /* each packet arrives a delay after the one ahead of it, as in the
+         emulator without the link model */
+      now = nowns();
+      if (lastdue < now)
+        lastdue = now;
+      lastdue += channeldelay(side) * UNITNS;
+      s->due = lastdue;
+    }
+    tail++;
+    packets_sent++;
+  }
+  atomic_store_explicit(&r->tail, tail, memory_order_release);
+}
+
+void tolayer3(int AorB, struct pkt packet)
+{
+  tolayer3_batch(AorB, &packet, 1);
+}
+
+void tolayer5(int AorB, char datasent[20])
+{
+  int64_t stamp;
+
+  (void)AorB;
+  memcpy(&stamp, datasent, sizeof stamp);
+  total_latency += (double)(nowns() - stamp) / UNITNS;
+  messages_delivered++;
+}
+
+int main(int argc, char *argv[])
+{
+  double lambda, elapsed, firstactive = -1.0, lastheard = 0.0;
+  int64_t now, nextoffer = 0, lastdone = 0;
+  int fd, i, n, refused = 0, idle = 0;
+  bool finished;
+  pid_t child;
+
+  if (argc < 3) {
+    printf("usage: %s nmsgs lambda [lossprob corruptprob]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  nmsgs = atoi(argv[1]);
+  lambda = atof(argv[2]);
+  if (PRODUCERS == 0 && nmsgs > 0 && lambda <= 0.0) {
+    printf("lambda must be above 0\n");
+    return EXIT_FAILURE;
+  }
+  lossprob = argc > 3 ? atof(argv[3]) : 0.0;
+  corruptprob = argc > 4 ? atof(argv[4]) : 0.0;
+  corruptdirection = 2;           /* both directions */
+
+  /* the segment is mapped before the fork, so both sides share it */
+  fd = memfd_create("gbn_shm", 0);
+  if (fd < 0 || ftruncate(fd, sizeof *seg) < 0) {
+    perror("memfd_create");
+    return EXIT_FAILURE;
+  }
+  seg = mmap(NULL, sizeof *seg, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (seg == MAP_FAILED) {
+    perror("mmap");
+    return EXIT_FAILURE;
+  }
+  close(fd);
+  fflush(stdout);
+  child = fork();
+  if (child < 0) {
+    perror("fork");
+    return EXIT_FAILURE;
+  }
+  side = child == 0 ? B : A;
+  if (side == B)
+    nmsgs = 0;
+  srand(9999 + side);
+  channel_init();
+
+  startns = nowns();
+  if (side == A)
+    A_init();
+  else
+    B_init();
+  if (PRODUCERS > 0 && side == A) {
+    submit_init();
+    for (i = 0; i < PRODUCERS; i++) {
+      producers[i].id = i;
+      if (pthread_create(&producers[i].thread, NULL, produce, &producers[i]) != 0) {
+        printf("can not start the submitting threads\n");
+        return EXIT_FAILURE;
+      }
+    }
+  }
+  else if (nmsgs > 0)
+    nextoffer = startns + nextgap(lambda);
+
+  while (1) {
+    if (receive() > 0) {
+      lastheard = gettime();
+      if (firstactive < 0.0)
+        firstactive = lastheard;
+      idle = 0;
+    }
+    now = nowns();
+    if (timerrunning && now >= timerdue) {
+      timerrunning = false;
+      if (side == A)
+        A_timerinterrupt();
+      else
+        B_timerinterrupt();
+    }
+    if (PRODUCERS > 0 && side == A) {
+      if ((n = submit_drain()) > 0 && firstactive < 0.0)
+        firstactive = gettime();
+      messages_offered += n;
+    }
+    else if (messages_offered < nmsgs && now >= nextoffer) {
+      if (firstactive < 0.0)
+        firstactive = gettime();
+      offer();
+      nextoffer += nextgap(lambda);
+    }
+
+    finished = messages_offered == nmsgs && !timerrunning && gettime() - lastheard >= LINGER;
+    atomic_store_explicit(&seg->done[side], finished, memory_order_release);
+    if (finished && atomic_load_explicit(&seg->done[1 - side], memory_order_acquire))
+      break;
+    if (SPINS > 0 && ++idle >= SPINS) {
+      sched_yield();
+      yields++;
+      idle = 0;
+    }
+  }
+
+  /* B reports first, and A once B has */
+  if (side == A)
+    waitpid(child, NULL, 0);
+  if (PRODUCERS > 0 && side == A)
+    for (i = 0; i < PRODUCERS; i++) {
+      pthread_join(producers[i].thread, NULL);
+      refused += producers[i].refused;
+      if (producers[i].done > lastdone)
+        lastdone = producers[i].done;
+    }
+
+  /* the run lasted from the first message or packet to the last packet,
+     not through the linger after it */
+  elapsed = lastheard - firstactive;
+  if (elapsed <= 0.0)
+    elapsed = gettime();
+  printf("%c: run over after %f time units of %f us\n", side == A ? 'A' : 'B', elapsed, UNITNS / 1e3);
+  printf("number of messages offered by layer 5:  %d \n", messages_offered);
+  printf("number of messages dropped due to full window:  %d \n", window_full);
+  if (PRODUCERS > 0 && side == A) {
+    printf("messages submitted per second by %d threads:  %f \n", PRODUCERS,
+           messages_offered / ((lastdone - startns) / 1e9));
+    printf("number of times a submission found the queue full:  %d \n", refused);
+  }
+  printf("number of packet resends:  %d \n", packets_resent);
+  printf("number of messages delivered to application:  %d \n", messages_delivered);
+  if (messages_delivered > 0) {
+    printf("messages delivered per second:  %f \n", messages_delivered / (elapsed * UNITNS / 1e9));
+    printf("average time from offering a message to delivering it:  %f \n", total_latency / messages_delivered);
+  }
+  printf("number of packets sent:  %d, %d not taken by a full ring \n", packets_sent, packets_dropped);
+  if (IMPAIR)
+    printf("number of packets lost:  %d, corrupted:  %d \n", packets_lost, packets_corrupted);
+  printf("number of packets received:  %d \n", packets_in);
+  printf("packets sent and received per second:  %f \n", (packets_sent + packets_in) / (elapsed * UNITNS / 1e9));
+  printf("number of times the CPU was given up while idle:  %d \n", yields);
+  if (packets_ACKed > 0)
+    printf("average time from first sending a packet to its ACK:  %f \n", total_ACK_delay / packets_ACKed);
+  return EXIT_SUCCESS;
+}
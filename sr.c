@@ -4,6 +4,8 @@
 #include <string.h>
 #include "emulator.h"
 #include "sr.h"
+#include "fec.h"
+#include "arq.h"
 
 /* ******************************************************************
    Go Back N protocol.  Adapted from J.F.Kurose
@@ -21,327 +23,470 @@
    - removed bidirectional GBN code and other code not used by prac. 
    - fixed C style to adhere to current programming style
    - added GBN implementation
+   - restored bidirectional transfer, with ACKs piggybacked on data
 **********************************************************************/
 
-#define RTT  16.0       /* round trip time.  MUST BE SET TO 16.0 when submitting assignment */
 #define WINDOWSIZE 6    /* the maximum number of buffered unacked packet */
 #define SEQSPACE 12     /* the min sequence space for GBN must be at least windowsize + 1 */
-#define NOTINUSE (-1)   /* used to fill header fields that are not being used */
-
-/* generic procedure to compute the checksum of a packet.  Used by both sender and receiver  
-   the simulator will overwrite part of your packet with 'z's.  It will not overwrite your 
-   original checksum.  This procedure must generate a different checksum to the original if
-   the packet is corrupted.
-*/
-int ComputeChecksum(struct pkt packet)
+
+/********* Sender variables and functions ************/
+
+struct sender {
+  struct pkt buffer[WINDOWSIZE];  /* array for storing packets waiting for ACK */
+  float sendtime[WINDOWSIZE];     /* time each packet in buffer was first sent */
+  int windowcount;                /* the number of packets currently awaiting an ACK */
+  int nextseqnum;                 /* the next sequence number to be used by the sender */
+  bool resent[WINDOWSIZE];        /* each packet in buffer sent more than once, so its ACK gives no RTT sample */
+  int first_seq;                  /*record the first seq num of the window*/
+};
+
+/********* Receiver variables ************/
+
+struct receiver {
+  struct pkt buffer[WINDOWSIZE];  /* packets received but not yet delivered, from base */
+  int base;                       /* the sequence number at the start of the window */
+  int pending[WINDOWSIZE];        /* in-order sequence numbers delivered but not yet ACKed */
+  int npending;                   /* number of entries in pending */
+  float naktime[SEQSPACE];        /* when each sequence number was last NAKed, NOTINUSE if never */
+  float arrived[WINDOWSIZE];      /* when each packet in buffer arrived */
+  int path;                       /* the path the last data packet came in on, which ACKs go back on */
+};
+
+static struct sender snd[NFLOWS][2];
+static struct receiver rcv[NFLOWS][2];
+
+const int seqspace = SEQSPACE;
+const int receiversize = sizeof(struct receiver);
+
+/* the ACK number to carry on an outgoing data packet.  The newest held back
+   ACK goes out on the packet; if there is none there is nothing to carry */
+static int piggyback(int AorB, int flow)
 {
-  int checksum = 0;
-  int i;
+  struct receiver *r = &rcv[flow][AorB];
 
-  checksum = packet.seqnum;
-  checksum += packet.acknum;
-  for ( i=0; i<20; i++ ) 
-    checksum += (int)(packet.payload[i]);
+  if (r->npending == 0)
+    return NOTINUSE;
 
-  return checksum;
+  ACKs_piggybacked++;
+  if (r->npending == 1)
+    ackdeadline[flow][AorB] = NOTINUSE;
+  return r->pending[--r->npending];
 }
 
-bool IsCorrupted(struct pkt packet)
+/* send a pure ACK for seqnum from the flow's receiver r.  Any ACKs being
+   held back are flagged in the payload, entry i standing for sequence
+   number seqnum - 1 - i */
+static void sendACK(int AorB, int flow, struct receiver *r, int seqnum)
 {
-  if (packet.checksum == ComputeChecksum(packet))
-    return (false);
-  else
-    return (true);
+  struct pkt sendpkt;
+  int i;
+  int offset;
+
+  sendpkt.acknum = seqnum;
+  sendpkt.seqnum = NOTINUSE;
+  sendpkt.nmsgs = 0;
+  sendpkt.flow = flow;
+  sendpkt.fec = NOTINUSE;
+  sendpkt.path = r->path;
+  /* we don't have any data to send.  fill payload with 0's */
+  for (i = 0; i < MTU; i++)
+    sendpkt.payload[i] = '0';
+
+  /* this ACK carries every held back ACK */
+  for (i = 0; i < r->npending; i++)
+  {
+    offset = (seqnum - 1 - r->pending[i] + SEQSPACE) % SEQSPACE;
+    if (offset < WINDOWSIZE)
+      sendpkt.payload[offset] = '1';
+  }
+  r->npending = 0;
+  ackdeadline[flow][AorB] = NOTINUSE;
+
+  /* computer checksum */
+  sendpkt.checksum = ComputeChecksum(sendpkt);
+  /*send ack*/
+  fec_send(AorB, &sendpkt, 1, false);
 }
 
+/* true if the next sequence number falls inside the send window */
+bool windowopen(int AorB, int flow)
+{
+  struct sender *s = &snd[flow][AorB];
+  int seqfirst = s->first_seq;
+  int seqlast = (s->first_seq + WINDOWSIZE-1) % SEQSPACE;
 
-/********* Sender (A) variables and functions ************/
+  return ((seqfirst <= seqlast) && (s->nextseqnum >= seqfirst && s->nextseqnum <= seqlast)) ||
+    ((seqfirst > seqlast) && (s->nextseqnum >= seqfirst || s->nextseqnum <= seqlast));
+}
 
-static struct pkt buffer[WINDOWSIZE];  /* array for storing packets waiting for ACK */
-static int windowfirst, windowlast;    /* array indexes of the first/last packet awaiting ACK */
-static int windowcount;                /* the number of packets currently awaiting an ACK */
-static int A_nextseqnum;               /* the next sequence number to be used by the sender */
-static int first_seq;               /*record the first seq num of the window*/
+/* the number of packets awaiting an ACK */
+int inflight(int AorB, int flow)
+{
+  return snd[flow][AorB].windowcount;
+}
 
-/* called from layer 5 (application layer), passed the message to be sent to other side */
-void A_output(struct msg message)
+/* put n messages in a packet and send it; the window must have room for it */
+void sendmessage(int AorB, int flow, struct msg messages[], int n)
 {
+  struct sender *s = &snd[flow][AorB];
   struct pkt sendpkt;
   int i;
   int index;
-  int seqfirst = first_seq;
-  int seqlast = (first_seq + WINDOWSIZE-1) % SEQSPACE;
-  
-
-  /* if not blocked waiting on ACK */
-  if (((seqfirst <= seqlast) && (A_nextseqnum >= seqfirst && A_nextseqnum <= seqlast)) ||
-    ((seqfirst > seqlast) && (A_nextseqnum >= seqfirst || A_nextseqnum <= seqlast)))
-  {
-    if (TRACE > 1)
-      printf("----A: New message arrives, send window is not full, send new messge to layer3!\n");
-
-    /* create packet */
-    sendpkt.seqnum = A_nextseqnum;
-    sendpkt.acknum = NOTINUSE;
-    for ( i=0; i<20 ; i++ ) 
-      sendpkt.payload[i] = message.data[i];
-    sendpkt.checksum = ComputeChecksum(sendpkt); 
-
-    /* put packet in window buffer */
-    if (A_nextseqnum >= seqfirst)
-      index = A_nextseqnum - seqfirst;
+  int seqfirst = s->first_seq;
+
+  /* create packet */
+  sendpkt.seqnum = s->nextseqnum;
+  sendpkt.acknum = NOTINUSE;
+  sendpkt.nmsgs = n;
+  sendpkt.flow = flow;
+  sendpkt.fec = NOTINUSE;
+  sendpkt.path = choosepath(AorB);
+  for ( i=0; i<MTU ; i++ ) 
+    if (i < 20 * n)
+      sendpkt.payload[i] = messages[i / 20].data[i % 20];
     else
-      index = WINDOWSIZE - seqfirst + A_nextseqnum;
-    buffer[index] = sendpkt;
-    windowcount++;
+      sendpkt.payload[i] = '0';
+  sendpkt.checksum = ComputeChecksum(sendpkt); 
 
-    /* send out packet */
-    if (TRACE > 0)
-      printf("Sending packet %d to layer 3\n", sendpkt.seqnum);
-    tolayer3 (A, sendpkt);
+  /* put packet in window buffer */
+  if (s->nextseqnum >= seqfirst)
+    index = s->nextseqnum - seqfirst;
+  else
+    index = SEQSPACE - seqfirst + s->nextseqnum;
+  s->buffer[index] = sendpkt;
+  s->sendtime[index] = gettime();
+  s->resent[index] = false;
+  s->windowcount++;
+
+  /* send out packet, with a held back ACK riding on it */
+  sendpkt.acknum = piggyback(AorB, flow);
+  sendpkt.checksum = ComputeChecksum(sendpkt); 
+  if (TRACE > 0)
+    printf("Sending packet %d to layer 3\n", sendpkt.seqnum);
+  fec_send(AorB, &sendpkt, 1, false);
 
-    /* start timer if first packet in window */
-    if (windowcount == 1)
-      starttimer(A,RTT);
+  /* start timer if first packet in window */
+  if (s->windowcount == 1)
+    rtodeadline[flow][AorB] = gettime() + RTT;
 
-    /* get next sequence number, wrap back to 0 */
-    A_nextseqnum = (A_nextseqnum + 1) % SEQSPACE;  
-  }
-  /* if blocked,  window is full */
-  else {
-    if (TRACE > 0)
-      printf("----A: New message arrives, send window is full\n");
-    window_full++;
-  }
+  /* get next sequence number, wrap back to 0 */
+  s->nextseqnum = (s->nextseqnum + 1) % SEQSPACE;  
 }
 
 
-/* called from layer 3, when a packet arrives for layer 4 
-   In this practical this will always be an ACK as B never sends data.
-*/
-void A_input(struct pkt packet)
+/* mark the packet with sequence number acknum as ACKed, if it is in the window */
+static void markACK(int AorB, int flow, int acknum)
 {
-  int ackcount = 0;
-  int i;
+  struct sender *s = &snd[flow][AorB];
   int seqfirst;
   int seqlast;
   int index;
-  /* if received ACK is not corrupted */ 
-  if (!IsCorrupted(packet)) {
-    if (TRACE > 0)
-      printf("----A: uncorrupted ACK %d is received\n",packet.acknum);
-    total_ACKs_received++;
+  int outstanding;
 
-    /* check if new ACK or duplicate */
-    seqfirst = first_seq;
-    seqlast = (first_seq + WINDOWSIZE - 1) % SEQSPACE;
+  /* check if new ACK or duplicate */
+  seqfirst = s->first_seq;
+  seqlast = (s->first_seq + WINDOWSIZE - 1) % SEQSPACE;
+  outstanding = (s->nextseqnum - s->first_seq + SEQSPACE) % SEQSPACE; /* packets held in buffer */
+
+  /* check case when seqnum has and hasn't wrapped */
+  if (((seqfirst <= seqlast) && (acknum >= seqfirst && acknum <= seqlast)) ||
+      ((seqfirst > seqlast) && (acknum >= seqfirst || acknum <= seqlast))) 
+  {
+    if (acknum >= seqfirst)
+      index = acknum - seqfirst;
+    else
+      index = SEQSPACE - seqfirst + acknum;
 
-    /* check case when seqnum has and hasn't wrapped */
-    if (((seqfirst <= seqlast) && (packet.acknum >= seqfirst && packet.acknum <= seqlast)) ||
-        ((seqfirst > seqlast) && (packet.acknum >= seqfirst || packet.acknum <= seqlast))) 
+    if (index < outstanding && s->buffer[index].acknum == NOTINUSE)
     {
-      if (packet.acknum >= seqfirst)
-            index = packet.acknum - seqfirst;
-      else
-        index = WINDOWSIZE - seqfirst + packet.acknum;
+      /* packet is a new ACK */
+      if (TRACE > 0)
+        printf("----%c: ACK %d is not a duplicate\n", entityname[AorB], acknum);
+      new_ACKs++;
+      s->windowcount--;
+      s->buffer[index].acknum = acknum;
+      total_ACK_delay += gettime() - s->sendtime[index];
+      packets_ACKed++;
+      flow_ACK_delay[flow] += gettime() - s->sendtime[index];
+      flow_ACKed[flow]++;
+      if (NPATHS > 1 && !s->resent[index])
+        pathsample(AorB, s->buffer[index].path, gettime() - s->sendtime[index]);
+    }
+    else
+    {
+      if (TRACE > 0)
+        printf("----%c: duplicate ACK received, do nothing!\n", entityname[AorB]);
+    }
+  }
+}
 
+/* mark the packets an uncorrupted ACK (pure or piggybacked) is for */
+static void markACKs(int AorB, int flow, struct pkt packet)
+{
+  int i;
 
-      if (buffer[index].acknum == NOTINUSE)
-      {
-        /* packet is a new ACK */
-        if (TRACE > 0)
-          printf("----A: ACK %d is not a duplicate\n", packet.acknum);
-        new_ACKs++;
-        windowcount--;
-        buffer[index].acknum = packet.acknum;
-      }
-      else
-      {
-        if (TRACE > 0)
-          printf("----A: duplicate ACK received, do nothing!\n");
-      }
-      if (packet.acknum == seqfirst)
-      {
-        for (i = 0; i < WINDOWSIZE; i++)
-        {
-          if (buffer[i].acknum != NOTINUSE && strcmp(buffer[i].payload, "") != 0)
-            ackcount++;
-          else
-            break;
-        }
+  if (TRACE > 0)
+    printf("----%c: uncorrupted ACK %d is received\n", entityname[AorB], packet.acknum);
+  total_ACKs_received++;
+
+  markACK(AorB, flow, packet.acknum);
+  /* a coalesced pure ACK also covers the earlier sequence numbers flagged in its payload */
+  if (packet.seqnum == NOTINUSE)
+    for (i = 0; i < WINDOWSIZE; i++)
+      if (packet.payload[i] == '1')
+        markACK(AorB, flow, (packet.acknum - 1 - i + SEQSPACE) % SEQSPACE);
+}
 
-        first_seq = (first_seq + ackcount) % SEQSPACE;
+/* called when an uncorrupted ACK (pure or piggybacked) arrives at the sender */
+static void ackinput(int AorB, int flow, struct pkt packet)
+{
+  struct sender *s = &snd[flow][AorB];
+  int ackcount = 0;
+  int i;
+  int outstanding;
 
-        /*update buffer*/
-        for (i = 0; i < WINDOWSIZE; i++)
-        {
-          if (buffer[i + ackcount].acknum == NOTINUSE || (buffer[i].seqnum + ackcount) % SEQSPACE == A_nextseqnum)
-            buffer[i] = buffer[i + ackcount];
-        }
-        /*Reset timer*/
-        stoptimer(A);
-        if (windowcount > 0)
-          starttimer(A, RTT);
-      }
-      else
-      {
-        buffer[index].acknum = packet.acknum;
-      }
+  markACKs(AorB, flow, packet);
+
+  outstanding = (s->nextseqnum - s->first_seq + SEQSPACE) % SEQSPACE; /* packets held in buffer */
+  if (outstanding > 0 && s->buffer[0].acknum != NOTINUSE)
+  {
+    /* slide the window past every consecutively ACKed packet */
+    while (ackcount < outstanding && s->buffer[ackcount].acknum != NOTINUSE)
+      ackcount++;
+
+    s->first_seq = (s->first_seq + ackcount) % SEQSPACE;
+
+    /*update buffer*/
+    for (i = 0; i + ackcount < outstanding; i++)
+    {
+      s->buffer[i] = s->buffer[i + ackcount];
+      s->sendtime[i] = s->sendtime[i + ackcount];
+      s->resent[i] = s->resent[i + ackcount];
     }
+
+    /*Reset timer*/
+    if (s->windowcount > 0)
+      rtodeadline[flow][AorB] = gettime() + RTT;
+    else
+      rtodeadline[flow][AorB] = NOTINUSE;
+
+    /* the window has opened, send any messages waiting for it */
+    windowslid(AorB, flow);
   }
-  else 
-    if (TRACE > 0)
-      printf ("----A: corrupted ACK is received, do nothing!\n");
 }
 
-/* called when A's timer goes off */
-void A_timerinterrupt(void)
+/* called when the retransmission timeout expires */
+void timeout(int AorB, int flow)
 {
+  struct sender *s = &snd[flow][AorB];
+  struct pkt resend;
+
   if (TRACE > 0)
   {
-    printf("----A: time out,resend packets!\n");
-    printf("---A: resending packet %d\n", (buffer[0]).seqnum);
+    printf("----%c: time out,resend packets!\n", entityname[AorB]);
+    printf("---%c: resending packet %d\n", entityname[AorB], (s->buffer[0]).seqnum);
   }
-  tolayer3(A, buffer[0]);
+  /* only the oldest unACKed packet is timed, so the burst is the window base */
+  if (NPATHS > 1)
+    pathtimeout(AorB, s->buffer[0].path);
+  resend = s->buffer[0];
+  resend.acknum = piggyback(AorB, flow);
+  resend.path = s->buffer[0].path = choosepath(AorB);
+  s->resent[0] = true;
+  resend.checksum = ComputeChecksum(resend);
+  fec_send(AorB, &resend, 1, true);
   packets_resent++;
-  starttimer(A, RTT);
+  flow_resent[flow]++;
+  rtodeadline[flow][AorB] = gettime() + RTT;
 }       
 
 
-
-/* the following routine will be called once (only) before any other */
-/* entity A routines are called. You can use it to do any initialization */
-void A_init(void)
+/* called when an uncorrupted NAK arrives at the sender */
+static void nakinput(int AorB, int flow, int nakseq)
 {
-  /* initialise A's window, buffer and sequence number */
-  A_nextseqnum = 0;  /* A starts with seq num 0, do not change this */
-  windowfirst = 0;
-  windowlast = -1;   /* windowlast is where the last packet sent is stored.  
-		     new packets are placed in winlast + 1 
-		     so initially this is set to -1
-		   */
-  windowcount = 0;
-  first_seq = 0;
-}
+  struct sender *s = &snd[flow][AorB];
+  struct pkt resend;
+  int index;
+  int outstanding;
+
+  if (TRACE > 0)
+    printf("----%c: NAK %d is received\n", entityname[AorB], nakseq);
 
+  index = (nakseq - s->first_seq + SEQSPACE) % SEQSPACE;
+  outstanding = (s->nextseqnum - s->first_seq + SEQSPACE) % SEQSPACE; /* packets held in buffer */
+  if (index >= outstanding || s->buffer[index].acknum != NOTINUSE)
+    return;
 
+  /* resend just the missing packet now rather than wait for the timeout */
+  if (TRACE > 0)
+    printf("---%c: resending packet %d\n", entityname[AorB], nakseq);
+  resend = s->buffer[index];
+  resend.acknum = piggyback(AorB, flow);
+  resend.path = s->buffer[index].path = choosepath(AorB);
+  s->resent[index] = true;
+  resend.checksum = ComputeChecksum(resend);
+  fec_send(AorB, &resend, 1, true);
+  packets_resent++;
+  flow_resent[flow]++;
+  NAK_resends++;
+  if (index == 0)
+    rtodeadline[flow][AorB] = gettime() + RTT;
+}
 
-/********* Receiver (B)  variables and procedures ************/
 
-static int expectedseqnum; /* the sequence number expected next by the receiver */
-static int B_nextseqnum;   /* the sequence number for the next packets sent by B */
-static struct pkt B_buffer[WINDOWSIZE];  /* array for storing packets waiting for ACK */
-static int B_windowfirst, B_windowlast;    /* array indexes of the first/last packet awaiting ACK */
-static int B_seqfirst, B_seqlast, B_windowcount;
-static int last;
-static int B_base; 
-/* called from layer 3, when a packet arrives for layer 4 at B*/
-void B_input(struct pkt packet)
+/********* Receiver procedures ************/
+
+/* called when an uncorrupted data packet arrives at the flow's receiver r */
+static void datainput(int AorB, int flow, struct receiver *r, struct pkt packet)
 {
-  struct pkt sendpkt;
   int i;
   int B_seqfirst;
   int B_seqlast;
   int B_index;
   int count = 0;
+  int gap = 0;
 
-  /* if not corrupted and received packet is in order */
-  
-  if (!IsCorrupted(packet))
+  if (TRACE > 0)
+    printf("----%c: packet %d is correctly received, send ACK!\n", entityname[AorB], packet.seqnum);
+  packets_received++;
+  r->path = packet.path;
+  /* need to check if new packet or duplicate */
+  B_seqfirst = r->base;
+  B_seqlast = (r->base + WINDOWSIZE-1) % SEQSPACE;
+
+  if (((B_seqfirst <= B_seqlast) && (packet.seqnum >= B_seqfirst && packet.seqnum <= B_seqlast)) ||
+      ((B_seqfirst > B_seqlast) && (packet.seqnum >= B_seqfirst || packet.seqnum <= B_seqlast)))
   {
-    if (TRACE > 0)
-      printf("----B: packet %d is correctly received, send ACK!\n", packet.seqnum);
-    packets_received++;
-    /*create sendpkt*/
-    /* send an ACK for the received packet */
-    sendpkt.acknum = packet.seqnum;
-    sendpkt.seqnum = NOTINUSE;
-    /* we don't have any data to send.  fill payload with 0's */
-    for (i = 0; i < 20; i++)
-      sendpkt.payload[i] = '0';
-    /* computer checksum */
-    sendpkt.checksum = ComputeChecksum(sendpkt);
-    /*send ack*/
-    tolayer3(B, sendpkt);
-    /* need to check if new packet or duplicate */
-    B_seqfirst = B_base;
-    B_seqlast = (B_base + WINDOWSIZE-1) % SEQSPACE;
-
-    if (((B_seqfirst <= B_seqlast) && (packet.seqnum >= B_seqfirst && packet.seqnum <= B_seqlast)) ||
-        ((B_seqfirst > B_seqlast) && (packet.seqnum >= B_seqfirst || packet.seqnum <= B_seqlast)))
-    {
-
-      /*get index*/
-      if (packet.seqnum >= B_seqfirst)
-        B_index = packet.seqnum - B_seqfirst;
-      else
-        B_index = WINDOWSIZE - B_seqfirst + packet.seqnum;
 
-      last = last > B_index ? last:B_index;
+    /*get index*/
+    if (packet.seqnum >= B_seqfirst)
+      B_index = packet.seqnum - B_seqfirst;
+    else
+      B_index = SEQSPACE - B_seqfirst + packet.seqnum;
 
-      /*if not duplicate, save to buffer*/
+    /*if not duplicate, save to buffer*/
+    if (r->buffer[B_index].seqnum == NOTINUSE)
+    {
+      /*buffer it*/
+      r->buffer[B_index] = packet;
+      r->arrived[B_index] = gettime();
 
-      if (strcmp(B_buffer[B_index].payload, packet.payload) !=0)
+      /* deliver to receiving application, in order, from the base.  All
+         but the first were held for the gap this one filled */
+      while (count < WINDOWSIZE && r->buffer[count].seqnum != NOTINUSE)
       {
-        /*buffer it*/
-        packet.acknum = packet.seqnum;
-        B_buffer[B_index] = packet;
-        /*if it is the base*/
-        if (packet.seqnum == B_seqfirst){
-          for (i = 0; i < WINDOWSIZE; i++)
-          {
-            if (B_buffer[i].acknum >= 0 && strcmp(B_buffer[i].payload, "")!= 0)
-              count++;
-            else
-              break;
-          }
-          /* update state variables */
-          B_base = (B_base + count) % SEQSPACE;
-          /*update buffer*/
-          for (i = 0; i <WINDOWSIZE; i++)
-          {
-            if ((i + count) <= (last+1))
-              B_buffer[i] = B_buffer[i + count];
-          }
-
+        if (count > 0) {
+          hol_held++;
+          hol_delay += gettime() - r->arrived[count];
+        }
+        deliver(AorB, flow, r->buffer[count]);
+        count++;
+      }
+      /* update state variables */
+      r->base = (r->base + count) % SEQSPACE;
+      /*update buffer*/
+      for (i = 0; i < WINDOWSIZE; i++)
+      {
+        if (i + count < WINDOWSIZE) {
+          r->buffer[i] = r->buffer[i + count];
+          r->arrived[i] = r->arrived[i + count];
         }
-        /* deliver to receiving application */
-        tolayer5(B, packet.payload);
+        else
+          r->buffer[i].seqnum = NOTINUSE;
       }
     }
+    /* nothing could be delivered, so the packets before this one are missing */
+    if (count == 0)
+      gap = B_index;
   }
+
+  /* a packet that simply extends the in-order stream has its ACK held back
+     until ACKEVERY are pending or ACKDELAY has passed.  With data flowing
+     both ways this gives the ACK a chance to ride on a data packet.
+     Gaps, gap fills and duplicates are ACKed straight away */
+  if ((DELAYEDACK || BIDIRECTIONAL) && count == 1 && r->npending + 1 < ACKEVERY)
+  {
+    if (r->npending == 0)
+      ackdeadline[flow][AorB] = gettime() + ACKDELAY;
+    r->pending[r->npending++] = packet.seqnum;
+    return;
+  }
+  sendACK(AorB, flow, r, packet.seqnum);
+
+  /* NAK each missing packet, so it is resent without waiting for a timeout */
+  if (NAKS)
+    for (i = 0; i < gap; i++)
+      if (r->buffer[i].seqnum == NOTINUSE)
+        sendNAK(AorB, flow, r->path, r->naktime, (r->base + i) % SEQSPACE);
 }
 
-/* the following routine will be called once (only) before any other */
-/* entity B routines are called. You can use it to do any initialization */
-void B_init(void)
+
+/********* Entry points, called by arq.c ************/
+
+/* act on one packet that has arrived, r being the receiver of its flow */
+void packetinput(int AorB, struct receiver *r, struct pkt packet)
 {
-  int i;
-  expectedseqnum = 0;
-  B_nextseqnum = 1;
-  B_base = 0;
-  B_windowfirst = 0;
-  B_windowlast = -1; 
-  B_windowcount = 0;
-  B_seqfirst = 0;
-  B_seqlast = WINDOWSIZE - 1;
-  for (i = 0; i < WINDOWSIZE; i++) 
+  int flow = packet.flow;
+
+  if (IsCorrupted(packet) || !numbersinrange(packet)) {
+    if (TRACE > 0)
+      printf ("----%c: corrupted packet is received, do nothing!\n", entityname[AorB]);
+  }
+  else if (packet.seqnum == NAKSEQ)
+    nakinput(AorB, flow, packet.acknum);
+  else
   {
-    B_buffer[i].seqnum = NOTINUSE;  /*mark as empty*/ 
-  }}
-  
+    /* a data packet may carry an ACK, and a pure ACK carries no data */
+    if (packet.acknum != NOTINUSE)
+      ackinput(AorB, flow, packet);
+    if (packet.seqnum != NOTINUSE)
+      datainput(AorB, flow, r, packet);
+  }
+}
 
-/******************************************************************************
- * The following functions need be completed only for bi-directional messages *
- *****************************************************************************/
+/* a pure ACK in a batch is only marked, the window sliding once the last
+   of the run of pure ACKs for the flow is acted on */
+bool foldACK(int AorB, struct pkt packet, struct pkt next)
+{
+  (void)next;
+  markACKs(AorB, packet.flow, packet);
+  return true;
+}
 
-/* Note that with simplex transfer from a-to-B, there is no B_output() */
-void B_output(struct msg message)  
+/* no data went out to carry the held back ACKs, so send them on their own */
+void sendheldACK(int AorB, int flow)
 {
+  struct receiver *r = &rcv[flow][AorB];
+
+  r->npending--;
+  sendACK(AorB, flow, r, r->pending[r->npending]);
 }
 
-/* called when B's timer goes off */
-void B_timerinterrupt(void)
+/* the receiver half of a flow */
+struct receiver *receiverof(int AorB, int flow)
 {
+  return &rcv[flow][AorB];
 }
 
+/* initialise a receiver half, its window starting at sequence number 0 */
+void initreceiver(struct receiver *r)
+{
+  int i;
+
+  r->base = 0;
+  r->npending = 0;
+  r->path = 0;
+  for (i = 0; i < WINDOWSIZE; i++) 
+    r->buffer[i].seqnum = NOTINUSE;  /*mark as empty*/ 
+
+  for (i = 0; i < SEQSPACE; i++)
+    r->naktime[i] = NOTINUSE;
+}
+
+/* initialise a sender half's window and sequence number */
+void initsender(int AorB, int flow)
+{
+  snd[flow][AorB].nextseqnum = 0;  /* A starts with seq num 0, do not change this */
+  snd[flow][AorB].windowcount = 0;
+  snd[flow][AorB].first_seq = 0;
+}
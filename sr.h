@@ -2,10 +2,20 @@ extern void A_init(void);
 extern void B_init(void);
 extern void A_input(struct pkt);
 extern void B_input(struct pkt);
+extern void A_input_batch(struct pkt[], int);
+extern void B_input_batch(struct pkt[], int);
 extern void A_output(struct msg);
 extern void A_timerinterrupt(void);
+extern int A_accepts(int);
 
 /* included for extension to bidirectional communication */
+#ifndef BIDIRECTIONAL
 #define BIDIRECTIONAL 0       /*  0 = A->B  1 =  A<->B */
+#endif
 extern void B_output(struct msg);
-extern void B_timerinterrupt(void);
\ No newline at end of file
+extern void B_timerinterrupt(void);
+
+/* a receiver server's sessions, each with B's receiver state of its own */
+extern int B_sessionsize(void);
+extern void B_sessioninit(void *);
+extern void B_sessioninput(void *, struct pkt);
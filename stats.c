@@ -0,0 +1,37 @@
+#include "emulator.h"
+
+/* statistics updated by GBN */
+int window_full;   /* count of the number of messages dropped due to full window */
+int total_ACKs_received;
+int packets_resent;       /* count of the number of packets resent  */
+int new_ACKs;           /* count of the number of acks correctly received */
+int packets_received;  /* count of the packets received by receiver */
+int packets_ACKed;     /* count of the packets A has seen acknowledged */
+double total_ACK_delay; /* sum of the times from first sending a packet to its ACK */
+int ACKs_piggybacked;  /* count of ACKs carried on data packets rather than sent alone */
+int messages_queued;   /* count of messages put in the sender's send queue */
+int queue_full;        /* count of messages refused while the send queue was over its high watermark */
+int queue_blocked;     /* count of times the send queue reached its high watermark */
+int max_queue_depth;   /* the most messages ever held in a send queue */
+double total_queue_depth; /* sum of the send queue depths seen by arriving messages */
+double total_queue_delay; /* sum of the times messages waited in the send queue */
+int NAKs_sent;         /* count of NAKs sent by the receiver on seeing a gap */
+int NAK_resends;       /* count of packets resent because of a NAK rather than a timeout */
+int packets_packed;    /* count of data packets built with packing on */
+int messages_packed;   /* count of messages carried in those packets */
+int hol_held;          /* count of packets held in a reorder buffer for an earlier one */
+double hol_delay;      /* sum of the times they were held */
+
+/* per flow statistics, updated by GBN */
+int flow_offered[NFLOWS];   /* count of messages layer 5 gave the flow to send */
+int flow_delivered[NFLOWS]; /* count of the flow's messages delivered to layer 5 */
+int flow_dropped[NFLOWS];   /* count of the flow's messages dropped at the sender */
+int flow_resent[NFLOWS];    /* count of the flow's packets resent */
+int flow_ACKed[NFLOWS];     /* count of the flow's packets seen acknowledged */
+double flow_ACK_delay[NFLOWS]; /* sum of the flow's times from first sending a packet to its ACK */
+
+/* statistics updated by the FEC layer */
+int fec_data_sent;     /* count of data packets sent with FEC on */
+int parity_sent;       /* count of parity packets sent */
+int fec_recovered;     /* count of data packets rebuilt from parity, without a resend */
+double fec_time_saved; /* estimated time saved, one retransmission timeout per rebuilt packet */
@@ -0,0 +1,79 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include "emulator.h"
+#include "gbn.h"
+#include "submit.h"
+
+#define SUBMITQUEUE 1024     /* messages the queue holds, a power of 2 */
+#define SUBMITBATCH 32       /* the most messages handed to A by one drain */
+
+/* Each cell carries a sequence number that says whose turn it is.  A
+   cell at position pos is free for the producer claiming pos while its
+   number is pos, holds a message for the consumer once it is pos + 1,
+   and is free again, a lap later, at pos + SUBMITQUEUE.  Producers claim
+   positions by moving enqueuepos on with a compare and swap, so none of
+   them waits for a lock held by another */
+struct cell {
+  atomic_uint seq;
+  struct msg message;
+};
+
+static struct cell cells[SUBMITQUEUE];
+static _Alignas(64) atomic_uint enqueuepos; /* the next position a producer claims */
+static _Alignas(64) unsigned int dequeuepos; /* the next position drained, the consumer's alone */
+
+void submit_init(void)
+{
+  unsigned int i;
+
+  for (i = 0; i < SUBMITQUEUE; i++)
+    atomic_store_explicit(&cells[i].seq, i, memory_order_relaxed);
+  atomic_store_explicit(&enqueuepos, 0, memory_order_relaxed);
+  dequeuepos = 0;
+}
+
+bool submit(struct msg message)
+{
+  unsigned int pos = atomic_load_explicit(&enqueuepos, memory_order_relaxed);
+  struct cell *c;
+  int turn;
+
+  while (1) {
+    c = &cells[pos & (SUBMITQUEUE - 1)];
+    turn = (int)(atomic_load_explicit(&c->seq, memory_order_acquire) - pos);
+    if (turn == 0) {
+      /* the cell is free: claim it, unless another producer got there first */
+      if (atomic_compare_exchange_weak_explicit(&enqueuepos, &pos, pos + 1,
+                                                memory_order_relaxed, memory_order_relaxed))
+        break;
+    }
+    else if (turn < 0)
+      return false;               /* still holding the message from a lap ago: full */
+    else
+      pos = atomic_load_explicit(&enqueuepos, memory_order_relaxed);
+  }
+  c->message = message;
+  atomic_store_explicit(&c->seq, pos + 1, memory_order_release);
+  return true;
+}
+
+int submit_drain(void)
+{
+  struct cell *c;
+  int n;
+
+  for (n = 0; n < SUBMITBATCH; n++) {
+    c = &cells[dequeuepos & (SUBMITQUEUE - 1)];
+    if (atomic_load_explicit(&c->seq, memory_order_acquire) != dequeuepos + 1)
+      break;                      /* empty, or the next producer has not finished */
+    if (!A_accepts(c->message.flow))
+      break;                      /* A would drop it: leave it, and those behind it */
+    flow_offered[c->message.flow]++;
+    A_output(c->message);
+    atomic_store_explicit(&c->seq, dequeuepos + SUBMITQUEUE, memory_order_release);
+    dequeuepos++;
+  }
+  return n;
+}
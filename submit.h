@@ -0,0 +1,25 @@
+/* ******************************************************************
+   Submission queue: a front-end to A's sender for applications that hand
+   it messages from many threads at once.  Any thread calls submit(); the
+   thread running the protocol calls submit_drain() in its loop, which
+   passes the messages on to A_output() in batches, in the order they
+   were submitted.  A message is taken out of the queue only once A would
+   send or queue it, so when A's window and send queue are full the
+   submission queue fills in turn, and submit() says so, rather than A
+   dropping the message.
+
+   Build with the protocol and a backend run from one thread, with
+   -pthread for the submitting threads.
+**********************************************************************/
+
+/* set up the queue, empty */
+extern void submit_init(void);
+
+/* from any thread, queue a message (struct msg) for A to send.  Returns
+   false, for the caller to try again later, if the queue is full */
+extern bool submit(struct msg);
+
+/* from the protocol's thread, hand A the messages at the front of the
+   queue for as long as it takes them, at most SUBMITBATCH.  Returns how
+   many it took */
+extern int submit_drain(void);
@@ -0,0 +1,415 @@
+/* ******************************************************************
+   UDP backend: runs the same protocol code as the emulator, but over real
+   UDP sockets on loopback, with A and B in separate processes.  Packets
+   handed to layer 3 go out as datagrams, and the entity's timer is a
+   timerfd, all waited on with epoll.  Packets are sent with sendmmsg and
+   received with recvmmsg, so that one system call moves a whole batch,
+   each in the compact wire format (wire.c).
+
+   Build and run, each side in its own terminal or in the background:
+     gcc -O2 -o gbn_udp udp.c wire.c stats.c arq.c gbn.c fec.c -lm
+     ./gbn_udp B 0 0
+     ./gbn_udp A 100000 0.05
+
+   Each side offers nmsgs messages, one every lambda time units on average,
+   as the emulator does.  A side stops once it has offered them all, has no
+   timer running and has heard nothing for LINGER time units.  Messages
+   carry the time they were offered, so the receiver can tell how long each
+   took to be delivered; A and B read the same clock, being on one host.
+   A side can be given a port to bind other than its own, so that several
+   A sides can run at once against a receiver server (server.c), and a
+   port to send to other than the other side's, to go through the
+   impairment proxy (proxy.c).
+   Linux only.
+**********************************************************************/
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include "emulator.h"
+#include "gbn.h"
+#include "wire.h"
+
+#define PORT 40000           /* A listens on PORT, B on PORT + 1 */
+#define UNITNS 1000000       /* nanoseconds in one time unit, so an RTT of 16 is 16 ms */
+#define BATCH 64             /* the most datagrams moved by one sendmmsg or recvmmsg */
+#define LINGER 1000.0        /* time units without a packet before a side that is done stops */
+
+int TRACE = 0;
+
+/* statistics updated by the backend */
+static int messages_offered;      /* number of messages given to the protocol */
+static int messages_delivered;    /* number delivered to layer 5 */
+static double total_latency;      /* sum of the times from offering a message to delivering it */
+static int packets_sent;          /* number of datagrams sent */
+static int packets_dropped;       /* number the socket would not take */
+static int packets_in;            /* number of datagrams received */
+static int send_calls;            /* number of sendmmsg calls */
+static int recv_calls;            /* number of recvmmsg calls that returned datagrams */
+
+static int side;                  /* A or B, the entity this process runs */
+static int sock;                  /* the socket, connected to the other side */
+static int timerfd;               /* the entity's timer */
+static int arrivalfd;             /* when layer 5 offers the next message */
+static bool timerrunning;
+static int64_t timerdue;          /* when the entity's timer is due */
+static int64_t timerslack;        /* and how late it may go off, in nanoseconds */
+static int64_t armedat;           /* when the timerfd goes off, 0 if disarmed */
+static int timer_calls;           /* number of times the timer was started or stopped */
+static int settime_calls;         /* number of timerfd_settime calls they took */
+static int64_t startns;           /* the clock when the run started */
+
+static struct pkt outq[BATCH];    /* packets waiting to be sent, oldest first */
+static int noutq;
+
+/* the monotonic clock, in nanoseconds */
+static int64_t nowns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* arm a timerfd to go off after the given time units, 0 to disarm it */
+static void armtimer(int fd, double units)
+{
+  struct itimerspec its;
+  int64_t ns = units * UNITNS;
+
+  memset(&its, 0, sizeof its);
+  if (units != 0.0 && ns <= 0)
+    ns = 1;                       /* a zero value would disarm it, and a time passed is due now */
+  its.it_value.tv_sec = ns / 1000000000;
+  its.it_value.tv_nsec = ns % 1000000000;
+  if (timerfd_settime(fd, 0, &its, NULL) < 0) {
+    perror("timerfd_settime");
+    exit(EXIT_FAILURE);
+  }
+}
+
+/* send everything waiting in the queue, a batch to a system call */
+static void flush(void)
+{
+  struct mmsghdr msgs[BATCH];
+  struct iovec iovs[BATCH];
+  unsigned char bufs[BATCH][WIREMAX];
+  int i, n, sent = 0;
+
+  memset(msgs, 0, sizeof msgs);
+  for (i = 0; i < noutq; i++) {
+    iovs[i].iov_base = bufs[i];
+    iovs[i].iov_len = wire_encode(&outq[i], bufs[i]);
+    msgs[i].msg_hdr.msg_iov = &iovs[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
+  }
+  while (sent < noutq) {
+    n = sendmmsg(sock, msgs + sent, noutq - sent, 0);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      if (errno != EAGAIN && errno != EWOULDBLOCK && errno != ECONNREFUSED) {
+        perror("sendmmsg");
+        exit(EXIT_FAILURE);
+      }
+      /* a full socket buffer or a side not listening yet: the rest are
+         lost, as the network might lose them */
+      packets_dropped += noutq - sent;
+      break;
+    }
+    send_calls++;
+    packets_sent += n;
+    sent += n;
+  }
+  noutq = 0;
+}
+
+/* take every datagram waiting on the socket, a batch to a system call, and
+   hand each to the entity */
+static void receive(void)
+{
+  struct mmsghdr msgs[BATCH];
+  struct iovec iovs[BATCH];
+  unsigned char bufs[BATCH][WIREMAX + 1]; /* a byte over, so a longer datagram does not decode */
+  struct pkt packets[BATCH];
+  int i, k, n;
+
+  while (1) {
+    memset(msgs, 0, sizeof msgs);
+    for (i = 0; i < BATCH; i++) {
+      iovs[i].iov_base = bufs[i];
+      iovs[i].iov_len = sizeof bufs[i];
+      msgs[i].msg_hdr.msg_iov = &iovs[i];
+      msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    n = recvmmsg(sock, msgs, BATCH, MSG_DONTWAIT, NULL);
+    if (n < 0) {
+      if (errno == EINTR || errno == ECONNREFUSED)
+        continue;
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        perror("recvmmsg");
+        exit(EXIT_FAILURE);
+      }
+      return;
+    }
+    recv_calls++;
+    /* the whole batch goes to the entity in one call, less any stray datagrams */
+    for (i = k = 0; i < n; i++)
+      if (wire_decode(bufs[i], msgs[i].msg_len, &packets[k]) == 0)
+        k++;
+    packets_in += k;
+    if (k > 0 && side == A)
+      A_input_batch(packets, k);
+    else if (k > 0)
+      B_input_batch(packets, k);
+    if (n < BATCH)
+      return;
+  }
+}
+
+/* layer 5 offers the entity its next message, stamped with the time */
+static void offer(void)
+{
+  struct msg message;
+  int64_t stamp = nowns();
+  int i;
+
+  for (i = 0; i < 20; i++)
+    message.data[i] = 'a' + messages_offered % 26;
+  memcpy(message.data, &stamp, sizeof stamp);
+  message.flow = messages_offered % NFLOWS;
+  flow_offered[message.flow]++;
+  messages_offered++;
+  if (side == A)
+    A_output(message);
+  else
+    B_output(message);
+}
+
+/********************** Student-callable ROUTINES ***********************/
+
+float gettime(void)
+{
+  return (double)(nowns() - startns) / UNITNS;
+}
+
+/* the timerfd is left armed when the timer stops, and kept when it starts
+   again if it goes off early, when it is set again for the timer, or late
+   by no more than the slack, so rearming the timer on every ACK does not
+   take a system call each time */
+void starttimer(int AorB, double increment)
+{
+  starttimer_slack(AorB, increment, 0.0);
+}
+
+void starttimer_slack(int AorB, double increment, double slack)
+{
+  int64_t now = nowns();
+
+  (void)AorB;
+  if (timerrunning) {
+    printf("Warning: attempt to start a timer that is already started\n");
+    return;
+  }
+  timer_calls++;
+  timerdue = now + (int64_t)(increment * UNITNS);
+  timerslack = slack > 0.0 ? (int64_t)(slack * UNITNS) : 0;
+  timerrunning = true;
+  if (armedat != 0 && armedat <= timerdue + timerslack)
+    return;
+  armedat = timerdue + timerslack;
+  armtimer(timerfd, (double)(armedat - now) / UNITNS);
+  settime_calls++;
+}
+
+void stoptimer(int AorB)
+{
+  (void)AorB;
+  if (!timerrunning) {
+    printf("Warning: unable to cancel your timer. It wasn't running.\n");
+    return;
+  }
+  timer_calls++;
+  timerrunning = false;
+}
+
+/* packets are queued, and go out together when the entity has finished
+   acting on the event in hand, or the queue is full */
+void tolayer3_batch(int AorB, struct pkt packets[], int count)
+{
+  int k;
+
+  (void)AorB;
+  for (k = 0; k < count; k++) {
+    if (noutq == BATCH)
+      flush();
+    outq[noutq++] = packets[k];
+  }
+}
+
+void tolayer3(int AorB, struct pkt packet)
+{
+  tolayer3_batch(AorB, &packet, 1);
+}
+
+void tolayer5(int AorB, char datasent[20])
+{
+  int64_t stamp;
+
+  (void)AorB;
+  memcpy(&stamp, datasent, sizeof stamp);
+  total_latency += (double)(nowns() - stamp) / UNITNS;
+  messages_delivered++;
+}
+
+int main(int argc, char *argv[])
+{
+  struct sockaddr_in addr;
+  struct epoll_event ev, evs[3];
+  uint64_t expirations;
+  double lambda, elapsed, firstactive = -1.0, lastheard = 0.0;
+  int nmsgs, port, peerport, ep, i, n;
+
+  if (argc < 4 || (argv[1][0] != 'A' && argv[1][0] != 'B')) {
+    printf("usage: %s A|B nmsgs lambda [port [peerport]]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  side = argv[1][0] == 'A' ? A : B;
+  nmsgs = atoi(argv[2]);
+  lambda = atof(argv[3]);
+  if (nmsgs > 0 && lambda <= 0.0) {
+    printf("lambda must be above 0\n");
+    return EXIT_FAILURE;
+  }
+  port = argc > 4 ? atoi(argv[4]) : PORT + side;
+  peerport = argc > 5 ? atoi(argv[5]) : PORT + 1 - side;
+  srand(9999 + port - PORT);     /* a sequence of its own for each port */
+
+  /* bind to this side's port, and send only to the other side's */
+  sock = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+  if (sock < 0) {
+    perror("socket");
+    return EXIT_FAILURE;
+  }
+  memset(&addr, 0, sizeof addr);
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(port);
+  if (bind(sock, (struct sockaddr *)&addr, sizeof addr) < 0) {
+    perror("bind");
+    return EXIT_FAILURE;
+  }
+  addr.sin_port = htons(peerport);
+  if (connect(sock, (struct sockaddr *)&addr, sizeof addr) < 0) {
+    perror("connect");
+    return EXIT_FAILURE;
+  }
+
+  timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+  arrivalfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+  ep = epoll_create1(0);
+  if (timerfd < 0 || arrivalfd < 0 || ep < 0) {
+    perror("timerfd_create or epoll_create1");
+    return EXIT_FAILURE;
+  }
+  ev.events = EPOLLIN;
+  ev.data.fd = sock;
+  epoll_ctl(ep, EPOLL_CTL_ADD, sock, &ev);
+  ev.data.fd = timerfd;
+  epoll_ctl(ep, EPOLL_CTL_ADD, timerfd, &ev);
+  ev.data.fd = arrivalfd;
+  epoll_ctl(ep, EPOLL_CTL_ADD, arrivalfd, &ev);
+
+  startns = nowns();
+  if (side == A)
+    A_init();
+  else
+    B_init();
+  if (nmsgs > 0)
+    armtimer(arrivalfd, lambda * 2 * rand() / RAND_MAX);
+
+  while (1) {
+    n = epoll_wait(ep, evs, 3, LINGER * UNITNS / 1000000);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      perror("epoll_wait");
+      return EXIT_FAILURE;
+    }
+    for (i = 0; i < n; i++) {
+      if (evs[i].data.fd == sock) {
+        receive();
+        lastheard = gettime();
+        if (firstactive < 0.0)
+          firstactive = lastheard;
+      }
+      else if (evs[i].data.fd == timerfd) {
+        if (read(timerfd, &expirations, sizeof expirations) == sizeof expirations) {
+          armedat = 0;
+          if (!timerrunning)
+            continue;             /* the timer was stopped since it was set */
+          if (nowns() < timerdue) {
+            /* it was set for an earlier start of the timer */
+            armedat = timerdue + timerslack;
+            armtimer(timerfd, (double)(armedat - nowns()) / UNITNS);
+            settime_calls++;
+            continue;
+          }
+          timerrunning = false;
+          if (side == A)
+            A_timerinterrupt();
+          else
+            B_timerinterrupt();
+        }
+      }
+      else if (read(arrivalfd, &expirations, sizeof expirations) == sizeof expirations) {
+        if (firstactive < 0.0)
+          firstactive = gettime();
+        offer();
+        /* the gap to the next message is uniform on [0, 2 lambda] */
+        if (messages_offered < nmsgs)
+          armtimer(arrivalfd, lambda * 2 * rand() / RAND_MAX);
+      }
+    }
+    flush();
+
+    if (messages_offered == nmsgs && !timerrunning && gettime() - lastheard >= LINGER
+        && (nmsgs > 0 || packets_in > 0))
+      break;
+  }
+
+  /* the run lasted from the first message or packet to the last packet,
+     not through the linger after it */
+  elapsed = lastheard - firstactive;
+  if (elapsed <= 0.0)
+    elapsed = gettime();
+  printf("%c: run over after %f time units of %f ms\n", side == A ? 'A' : 'B', elapsed, UNITNS / 1e6);
+  printf("number of messages offered by layer 5:  %d \n", messages_offered);
+  printf("number of messages dropped due to full window:  %d \n", window_full);
+  printf("number of packet resends:  %d \n", packets_resent);
+  printf("number of messages delivered to application:  %d \n", messages_delivered);
+  if (messages_delivered > 0) {
+    printf("messages delivered per second:  %f \n", messages_delivered / (elapsed * UNITNS / 1e9));
+    printf("average time from offering a message to delivering it:  %f \n", total_latency / messages_delivered);
+  }
+  printf("number of packets sent:  %d, in %d sendmmsg calls, %d not taken by the socket \n",
+         packets_sent, send_calls, packets_dropped);
+  printf("number of packets received:  %d, in %d recvmmsg calls \n", packets_in, recv_calls);
+  printf("packets sent and received per second:  %f \n", (packets_sent + packets_in) / (elapsed * UNITNS / 1e9));
+  if (timer_calls > 0)
+    printf("number of timerfd_settime calls:  %d, for %d timer starts and stops \n", settime_calls, timer_calls);
+  if (packets_ACKed > 0)
+    printf("average time from first sending a packet to its ACK:  %f \n", total_ACK_delay / packets_ACKed);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,129 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "emulator.h"
+#include "wire.h"
+
+#define NOTINUSE (-1)   /* the value of a header field that is not being used */
+#define PAD '0'         /* what the protocols fill unused payload bytes with */
+
+/* write an int as a varint, 7 bits to a byte, low bits first, the top bit
+   set on every byte but the last.  It is zigzagged first, so that small
+   negative values are short too.  Returns the bytes it took */
+static int putvarint(unsigned char *p, int value)
+{
+  unsigned int v = ((unsigned int)value << 1) ^ (unsigned int)(value >> 31);
+  int n = 0;
+
+  while (v >= 0x80) {
+    p[n++] = (v & 0x7f) | 0x80;
+    v >>= 7;
+  }
+  p[n++] = v;
+  return n;
+}
+
+/* read a varint from the bytes between p and end.  Returns the bytes it
+   took, or -1 if it runs past the end or is too long for an int */
+static int getvarint(const unsigned char *p, const unsigned char *end, int *value)
+{
+  unsigned int v = 0;
+  int n = 0;
+
+  do {
+    if (p + n == end || n == 5)
+      return -1;
+    v |= (unsigned int)(p[n] & 0x7f) << (7 * n);
+  } while (p[n++] & 0x80);
+  *value = (int)(v >> 1) ^ -(int)(v & 1);
+  return n;
+}
+
+/* read a field if the flags say it is there.  Returns where the next one
+   starts, or NULL if this one is bad or one before it was */
+static const unsigned char *getfield(const unsigned char *p, const unsigned char *end,
+                                     int present, int *value)
+{
+  int n;
+
+  if (p == NULL || !present)
+    return p;
+  n = getvarint(p, end, value);
+  return n < 0 ? NULL : p + n;
+}
+
+int wire_payload(const struct pkt *packet)
+{
+  int len = MTU;
+
+  if (FECPARITY(packet->fec))
+    return MTU;
+  if (packet->nmsgs > 0)
+    return packet->nmsgs < MTU / 20 ? 20 * packet->nmsgs : MTU;
+
+  /* flags, where set, are bytes other than PAD */
+  while (len > 0 && packet->payload[len - 1] == PAD)
+    len--;
+  return len;
+}
+
+int wire_encode(const struct pkt *packet, unsigned char *buf)
+{
+  int len = wire_payload(packet);
+  int n = 1;
+
+  buf[0] = 0;
+  if (packet->seqnum != NOTINUSE) {
+    buf[0] |= WIRESEQ;
+    n += putvarint(buf + n, packet->seqnum);
+  }
+  if (packet->acknum != NOTINUSE) {
+    buf[0] |= WIREACK;
+    n += putvarint(buf + n, packet->acknum);
+  }
+  if (packet->fec != NOTINUSE) {
+    buf[0] |= WIREFEC;
+    n += putvarint(buf + n, packet->fec);
+  }
+  if (packet->flow != 0) {
+    buf[0] |= WIREFLOW;
+    n += putvarint(buf + n, packet->flow);
+  }
+  if (packet->nmsgs != 0) {
+    buf[0] |= WIRENMSGS;
+    n += putvarint(buf + n, packet->nmsgs);
+  }
+  n += putvarint(buf + n, packet->checksum);
+  n += putvarint(buf + n, len);
+  memcpy(buf + n, packet->payload, len);
+  return n + len;
+}
+
+int wire_decode(const unsigned char *buf, int size, struct pkt *packet)
+{
+  const unsigned char *p = buf + 1, *end = buf + size;
+  int flags, len;
+
+  if (size < 1)
+    return -1;
+  flags = buf[0];
+  packet->seqnum = packet->acknum = packet->fec = NOTINUSE;
+  packet->flow = packet->nmsgs = 0;
+  packet->path = 0;
+  packet->resent = 0;
+
+  /* each field there is, in the order wire_encode() writes them */
+  p = getfield(p, end, flags & WIRESEQ, &packet->seqnum);
+  p = getfield(p, end, flags & WIREACK, &packet->acknum);
+  p = getfield(p, end, flags & WIREFEC, &packet->fec);
+  p = getfield(p, end, flags & WIREFLOW, &packet->flow);
+  p = getfield(p, end, flags & WIRENMSGS, &packet->nmsgs);
+  p = getfield(p, end, 1, &packet->checksum);
+  p = getfield(p, end, 1, &len);
+  if (p == NULL || len < 0 || len > MTU || p + len != end)
+    return -1;
+
+  memcpy(packet->payload, p, len);
+  memset(packet->payload + len, PAD, MTU - len);
+  return len == wire_payload(packet) ? 0 : -1;
+}
@@ -0,0 +1,37 @@
+/* ******************************************************************
+   Compact wire format for struct pkt.  The fixed format spends four bytes
+   on each header field and sends every payload byte a packet's messages
+   take up; this one sends a byte of flags, then only the fields that are
+   not at their usual value, each as a variable-length integer, so that a
+   sequence or ACK number from a small sequence space takes one byte.  The
+   payload goes last, with its length in front.  The length follows from
+   the header, as it does on the emulator's links: a data packet carries
+   its messages, a parity packet the whole payload.  An ACK or NAK carries
+   no messages, only the flags a protocol may set in its payload, so it
+   carries them up to the last that is set.  The '0' bytes the protocols
+   pad the rest of a payload with come back when it is decoded.  path is
+   not on the wire, and neither is resent.
+**********************************************************************/
+
+/* the most bytes a packet takes */
+#define WIREMAX (1 + 7 * 5 + MTU)
+
+/* the flags byte: which fields are on the wire.  The rest are NOTINUSE,
+   or for flow and nmsgs 0 */
+#define WIRESEQ   0x01
+#define WIREACK   0x02
+#define WIREFEC   0x04
+#define WIREFLOW  0x08
+#define WIRENMSGS 0x10
+
+/* write a packet (struct pkt *) to the buffer (unsigned char[WIREMAX]),
+   and return how many bytes it took */
+extern int wire_encode(const struct pkt *, unsigned char *);
+
+/* read a packet (struct pkt *) from the bytes (unsigned char *, int).
+   Returns 0, or -1 if they do not hold a whole packet, or its payload is
+   not as long as its header says */
+extern int wire_decode(const unsigned char *, int, struct pkt *);
+
+/* bytes of the payload a packet (struct pkt *) puts on the wire */
+extern int wire_payload(const struct pkt *);